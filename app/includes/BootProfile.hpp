@@ -0,0 +1,32 @@
+#pragma once
+#include "3ds.h"
+
+// Times the startup phases to see what delays the first usable moment. The
+// report is one info line, with the details at debug level one line per phase,
+// in the order they started:
+//
+//   <title>: <total> ms, slowest <phase> <duration> ms
+//   <title>: <phase> <duration> ms at <start> ms     (debug)
+//   <title>: <mark> at <time> ms                     (debug)
+//
+// Times are milliseconds since Start(). Marks are points in time, like the server
+// listening, and the total is the time to the last mark or phase end, so it is
+// the time to listening when reported right after that mark.
+namespace BootProfile {
+
+    // Clears the previous profile, phases are timed from here
+    void Start();
+
+    // Times the enclosing block, can be used from any thread
+    class Phase {
+    public:
+        Phase(const char* name);
+        ~Phase();
+    private:
+        int index;
+    };
+
+    void Mark(const char* name);
+
+    void Report(const char* title);
+}
@@ -8,6 +8,7 @@
 #include "Main.hpp"
 #include "plgldr.h"
 #include "BCLIM.hpp"
+#include "BootProfile.hpp"
 #include "logo.h"
 #include "plugin.h"
 #include "3gx.h"
@@ -49,17 +50,22 @@ error:
 bool extractPlugin() {
     u32 expectedVersion = SYSTEM_VERSION(VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION);
     bool plugin_needs_update = true;
-    FILE* f = fopen(artic_setup_plugin, "r");
-    if (f) {
-        _3gx_Header header;
-        int read = fread(&header, 1, sizeof(header), f);
-        if (read == sizeof(header) && header.magic == _3GX_MAGIC) {
-            plugin_needs_update = header.version != expectedVersion;
+    FILE* f;
+    {
+        BootProfile::Phase phase("checkPlugin");
+        f = fopen(artic_setup_plugin, "r");
+        if (f) {
+            _3gx_Header header;
+            int read = fread(&header, 1, sizeof(header), f);
+            if (read == sizeof(header) && header.magic == _3GX_MAGIC) {
+                plugin_needs_update = header.version != expectedVersion;
+            }
         }
+        if (f) fclose(f);
     }
-    if (f) fclose(f);
 
     if (plugin_needs_update) {
+        BootProfile::Phase phase("writePlugin");
         logger.Info("Updating Azahar Artic Setup plugin file");
         f = fopen_mkdir(artic_setup_plugin, "w");
         if (!f) {
@@ -77,6 +83,7 @@ bool extractPlugin() {
 }
 
 bool launchPlugin() {
+    BootProfile::Phase phase("launchPlugin");
 	u32 ret = 0;
 	PluginLoadParameters plgparam = { 0 };
 	u8 isPlgEnabled = 0;
@@ -136,27 +143,43 @@ bool checkEmulator() {
 PrintConsole topScreenConsole, bottomScreenConsole;
 int transferedBytes = 0;
 void Main() {
-    logger.Start();
-    logger.debug_enable = true;
+    BootProfile::Start();
+    {
+        BootProfile::Phase phase("logger");
+        logger.Start();
+        logger.debug_enable = true;
+    }
 
-    gfxInitDefault();
-	consoleInit(GFX_TOP, &topScreenConsole);
-    consoleInit(GFX_BOTTOM, &bottomScreenConsole);
-    topScreenConsole.bg = 15; topScreenConsole.fg = 0;
-    bottomScreenConsole.bg = 15; bottomScreenConsole.fg = 0;
+    {
+        BootProfile::Phase phase("gfxInitDefault");
+        gfxInitDefault();
+    }
 
-    gfxSetDoubleBuffering(GFX_BOTTOM, false);
+    {
+        BootProfile::Phase phase("console");
+        consoleInit(GFX_TOP, &topScreenConsole);
+        consoleInit(GFX_BOTTOM, &bottomScreenConsole);
+        topScreenConsole.bg = 15; topScreenConsole.fg = 0;
+        bottomScreenConsole.bg = 15; bottomScreenConsole.fg = 0;
+
+        gfxSetDoubleBuffering(GFX_BOTTOM, false);
 
-    aptSetHomeAllowed(false);
+        aptSetHomeAllowed(false);
 
-    consoleSelect(&bottomScreenConsole);
-    consoleClear();
-    consoleSelect(&topScreenConsole);
-    consoleClear();
+        consoleSelect(&bottomScreenConsole);
+        consoleClear();
+        consoleSelect(&topScreenConsole);
+        consoleClear();
+    }
 
-    bool isEmulator = checkEmulator();
+    bool isEmulator;
+    {
+        BootProfile::Phase phase("checkEmulator");
+        isEmulator = checkEmulator();
+    }
 
     {
+        BootProfile::Phase phase("logo");
         CTRPluginFramework::BCLIM((void*)__data_logo_bin, __data_logo_bin_size).Render(CTRPluginFramework::Rect<int>((320 - 128) / 2, (240 - 128) / 2, 128, 128));
     }
     logger.Raw(false, "\n      Azahar Artic Setup v%d.%d.%d\n", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION);
@@ -168,6 +191,8 @@ void Main() {
     if (isEmulator) {
         logger.Error("This tool can only be used on a real console.");
     }
+    BootProfile::Mark("ready");
+    BootProfile::Report("Boot");
 
     bool do_jump = false;
     while (aptMainLoop())
@@ -184,7 +209,9 @@ void Main() {
 
         if ((kDown & KEY_A) && !isEmulator) {
             logger.Info("Launching Azahar Artic Setup");
+            BootProfile::Start();
             bool done = extractPlugin() && launchPlugin();
+            BootProfile::Report("Launch");
             if (done) {
                 do_jump = true;
                 logger.Raw(true, "");
@@ -0,0 +1,215 @@
+#include "ArticClient.hpp"
+
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace ArticProtocolCommon;
+
+ArticClient::Param ArticClient::Buffer(const void* data, size_t size) {
+    Param p = {size <= sizeof(RequestParameter::data) ? RequestParameterType::IN_SMALL_BUFFER : RequestParameterType::IN_BIG_BUFFER, 0, {}};
+    p.buffer.assign((const u8*)data, (const u8*)data + size);
+    return p;
+}
+
+ArticClient::Param ArticClient::FSPath(FS_PathType type, const void* data, u32 size) {
+    std::vector<u8> path(8 + size);
+    u32 header[2] = {(u32)type, size};
+    memcpy(path.data(), header, sizeof(header));
+    memcpy(path.data() + 8, data, size);
+    return Buffer(path.data(), path.size());
+}
+
+ArticClient::Param ArticClient::FSPath(const char* asciiPath) {
+    if (!asciiPath[0])
+        return FSPath(PATH_EMPTY, "", 1);
+    return FSPath(PATH_ASCII, asciiPath, strlen(asciiPath) + 1);
+}
+
+const std::vector<u8>* ArticClient::Response::Get(u32 bufferID) const {
+    auto it = buffers.find(bufferID);
+    return it == buffers.end() ? nullptr : &it->second;
+}
+
+ArticClient::~ArticClient() {
+    Close();
+}
+
+bool ArticClient::Fail(const std::string& message) {
+    error = message;
+    return false;
+}
+
+bool ArticClient::Send(int fd, const void* data, size_t size) {
+    const u8* p = (const u8*)data;
+    while (size) {
+        ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return Fail(std::string("send: ") + strerror(errno));
+        p += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool ArticClient::Recv(int fd, void* data, size_t size) {
+    u8* p = (u8*)data;
+    while (size) {
+        ssize_t got = recv(fd, p, size, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return Fail(got ? std::string("recv: ") + strerror(errno) : "connection closed");
+        p += got;
+        size -= got;
+    }
+    return true;
+}
+
+int ArticClient::Open(const std::string& host, int port) {
+    addrinfo hints = {}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) || !res)
+        return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen)) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (linkShaper)
+            fd = linkShaper->Wrap(fd);
+    }
+    return fd;
+}
+
+bool ArticClient::Connect(const std::string& host, int port) {
+    Close();
+    mainFD = Open(host, port);
+    if (mainFD < 0)
+        return Fail("cannot connect to " + host + ":" + std::to_string(port));
+
+    std::string ports;
+    if (!SimpleRequest("PORTS", ports))
+        return false;
+
+    // Comma separated, only the first request port is used
+    int requestPort = atoi(ports.c_str());
+    if (requestPort <= 0) {
+        requestFD = mainFD;
+        return true;
+    }
+    requestFD = Open(host, requestPort);
+    if (requestFD < 0)
+        return Fail("cannot connect to request port " + std::to_string(requestPort));
+    return true;
+}
+
+void ArticClient::Close() {
+    if (requestFD >= 0 && requestFD != mainFD)
+        close(requestFD);
+    if (mainFD >= 0)
+        close(mainFD);
+    requestFD = mainFD = -1;
+}
+
+bool ArticClient::SimpleRequest(const std::string& name, std::string& out) {
+    RequestPacket req = {};
+    std::string method = "$" + name;
+    if (method.size() >= sizeof(req.method))
+        return Fail("simple request name too long");
+    req.requestID = nextRequestID++;
+    memcpy(&req.method[0], method.data(), method.size());
+
+    DataPacket resp;
+    if (!Send(mainFD, &req, sizeof(req)) || !Recv(mainFD, &resp, sizeof(resp)))
+        return false;
+    if (resp.requestID != req.requestID)
+        return Fail("simple request ID mismatch");
+    const char* raw = (const char*)&resp.dataRaw[0];
+    out.assign(raw, strnlen(raw, sizeof(resp.dataRaw)));
+    return true;
+}
+
+bool ArticClient::Call(const std::string& method, const std::vector<Param>& params, Response& out) {
+    RequestPacket req = {};
+    if (method.size() >= sizeof(req.method))
+        return Fail("method name too long");
+    if (requestFD < 0)
+        return Fail("not connected");
+    req.requestID = nextRequestID++;
+    memcpy(&req.method[0], method.data(), method.size());
+    req.parameterCount = (u32)params.size();
+
+    // Parameters, then the contents of the big buffers in order
+    std::vector<u8> packet(sizeof(req) + params.size() * sizeof(RequestParameter));
+    memcpy(packet.data(), &req, sizeof(req));
+    u16 bigBufferID = 0;
+    for (size_t i = 0; i < params.size(); i++) {
+        const Param& p = params[i];
+        RequestParameter rp = {};
+        rp.type = p.type;
+        switch (p.type) {
+        case RequestParameterType::IN_INTEGER_8: rp.parameterSize = 1; break;
+        case RequestParameterType::IN_INTEGER_16: rp.parameterSize = 2; break;
+        case RequestParameterType::IN_INTEGER_32: rp.parameterSize = 4; break;
+        case RequestParameterType::IN_INTEGER_64: rp.parameterSize = 8; break;
+        case RequestParameterType::IN_SMALL_BUFFER: rp.parameterSize = (u16)p.buffer.size(); break;
+        case RequestParameterType::IN_BIG_BUFFER: rp.bigBufferID = bigBufferID++; break;
+        }
+        if (p.type <= RequestParameterType::IN_INTEGER_64)
+            memcpy(&rp.data[0], &p.value, rp.parameterSize);
+        else if (p.type == RequestParameterType::IN_SMALL_BUFFER)
+            memcpy(&rp.data[0], p.buffer.data(), p.buffer.size());
+        memcpy(packet.data() + sizeof(req) + i * sizeof(RequestParameter), &rp, sizeof(rp));
+    }
+    bigBufferID = 0;
+    for (const Param& p : params) {
+        if (p.type != RequestParameterType::IN_BIG_BUFFER)
+            continue;
+        ArticProtocolCommon::Buffer header = {bigBufferID++, (u32)p.buffer.size()};
+        packet.insert(packet.end(), (const u8*)&header, (const u8*)(&header + 1));
+        packet.insert(packet.end(), p.buffer.begin(), p.buffer.end());
+    }
+    if (!Send(requestFD, packet.data(), packet.size()))
+        return false;
+
+    DataPacket resp;
+    if (!Recv(requestFD, &resp, sizeof(resp)))
+        return false;
+    if (resp.requestID != req.requestID)
+        return Fail("request ID mismatch");
+    if (resp.bufferSize < 0)
+        return Fail("invalid response size");
+
+    out = Response();
+    out.articResult = resp.articResult;
+    out.methodResult = resp.methodResult;
+    out.wireBytes = sizeof(resp) + resp.bufferSize;
+
+    // The result buffers follow as header and data pairs
+    std::vector<u8> data(resp.bufferSize);
+    if (!Recv(requestFD, data.data(), data.size()))
+        return false;
+    size_t offset = 0;
+    while (offset + sizeof(ArticProtocolCommon::Buffer) <= data.size()) {
+        ArticProtocolCommon::Buffer header;
+        memcpy(&header, data.data() + offset, sizeof(header));
+        offset += sizeof(header);
+        if (header.bufferSize > data.size() - offset)
+            return Fail("truncated result buffer");
+        out.buffers[header.bufferID].assign(data.begin() + offset, data.begin() + offset + header.bufferSize);
+        offset += header.bufferSize;
+    }
+    return true;
+}
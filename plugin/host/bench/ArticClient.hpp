@@ -0,0 +1,66 @@
+#pragma once
+#include "3ds.h"
+#include "ArticProtocolCommon.hpp"
+#include "LinkShaper.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Blocking client for one connection to the plugin server. Simple requests
+// ($VERSION, $PORTS...) go through the main socket, method calls through the
+// first request port returned by the server. The wire structures are the ones
+// of the ArticProtocol submodule.
+class ArticClient {
+public:
+    struct Param {
+        ArticProtocolCommon::RequestParameterType type;
+        s64 value;
+        std::vector<u8> buffer;
+    };
+
+    static Param S8(s8 value) { return {ArticProtocolCommon::RequestParameterType::IN_INTEGER_8, value, {}}; }
+    static Param S16(s16 value) { return {ArticProtocolCommon::RequestParameterType::IN_INTEGER_16, value, {}}; }
+    static Param S32(s32 value) { return {ArticProtocolCommon::RequestParameterType::IN_INTEGER_32, value, {}}; }
+    static Param S64(s64 value) { return {ArticProtocolCommon::RequestParameterType::IN_INTEGER_64, value, {}}; }
+    static Param Buffer(const void* data, size_t size);
+    // FS_Path as expected by GetFSPath: type, size and the path data
+    static Param FSPath(FS_PathType type, const void* data, u32 size);
+    static Param FSPath(const char* asciiPath);
+
+    struct Response {
+        ArticProtocolCommon::ArticResult articResult = ArticProtocolCommon::ArticResult::SUCCESS;
+        s32 methodResult = 0;
+        std::map<u32, std::vector<u8>> buffers;
+        // Bytes received for this request, headers included
+        size_t wireBytes = 0;
+
+        bool Good() const { return articResult == ArticProtocolCommon::ArticResult::SUCCESS && R_SUCCEEDED(methodResult); }
+        const std::vector<u8>* Get(u32 bufferID) const;
+    };
+
+    ~ArticClient();
+
+    // Sockets opened by Connect go through the shaper if set
+    void SetLinkShaper(LinkShaper* shaper) { linkShaper = shaper; }
+    bool Connect(const std::string& host, int port);
+    void Close();
+
+    bool SimpleRequest(const std::string& name, std::string& out);
+    // Returns false if the connection failed, method errors are in the response
+    bool Call(const std::string& method, const std::vector<Param>& params, Response& out);
+
+    const std::string& GetError() const { return error; }
+
+private:
+    bool Fail(const std::string& message);
+    bool Send(int fd, const void* data, size_t size);
+    bool Recv(int fd, void* data, size_t size);
+    int Open(const std::string& host, int port);
+
+    int mainFD = -1;
+    int requestFD = -1;
+    u32 nextRequestID = 1;
+    LinkShaper* linkShaper = nullptr;
+    std::string error;
+};
@@ -0,0 +1,295 @@
+// Microbenchmarks of the plugin's pure compute kernels on fixed, generated inputs.
+//
+// Usage: ComputeBench [-w warmup] [-r repetitions] [-t ms] [-f filter] [-c baseline.json] [-o out.json]
+//
+// Every case is calibrated to run for at least -t milliseconds per repetition, then
+// run -w times to warm up and -r times measured. The JSON output holds the median,
+// minimum, mean and standard deviation per operation and is stable across commits,
+// -c compares the medians against a previous output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <random>
+
+#include "ComputeBench.hpp"
+#include "LZSS.hpp"
+#include "BCLIM.hpp"
+#include "logo.h"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+using namespace CTRPluginFramework;
+using Clock = std::chrono::steady_clock;
+
+volatile u64 benchSink;
+
+static constexpr u64 CHECKSUM_MULTIPLIER = 0x6500000065ULL;
+// Close to the size of the NIM code binary
+static constexpr u32 LZSS_DECODED_SIZE = 0x180000;
+static constexpr u32 COLOR_COUNT = 0x1000;
+
+// Builds a compressed code binary decoding to an uncompressed prefix followed by a
+// mix of literals and back references, expected gets the decoded output.
+static void MakeLZSSInput(u32 decodedSize, std::vector<u8>& compressed, std::vector<u8>& expected)
+{
+    constexpr u32 prefix = 0x200;
+    std::mt19937 rng(0xC0DE);
+    u32 total = prefix + decodedSize;
+    expected.assign(total, 0);
+    for (u32 i = 0; i < prefix; i++)
+        expected[i] = (u8)rng();
+
+    // Bytes in the order the decoder reads them, from the end of the input
+    std::vector<u8> stream;
+    u32 out = total;
+    while (out > prefix) {
+        size_t controlPos = stream.size();
+        u8 control = 0;
+        stream.push_back(0);
+        for (int i = 0; i < 8 && out > prefix; i++) {
+            u32 written = total - out, remaining = out - prefix;
+            if (written >= 3 && remaining >= 3 && rng() % 3) {
+                u32 offset = 2 + rng() % (std::min<u32>(written - 1, 0x1001) - 1);
+                u32 size = std::min<u32>(3 + rng() % 16, remaining);
+                u16 raw = (u16)(((size - 3) << 12) | (offset - 2));
+                stream.push_back(raw >> 8);
+                stream.push_back(raw & 0xFF);
+                for (u32 j = 0; j < size; j++, out--)
+                    expected[out - 1] = expected[out + offset];
+                control |= 0x80 >> i;
+            } else {
+                // Code is far from random, keep literals in a small alphabet
+                u8 literal = (u8)(rng() % 64);
+                stream.push_back(literal);
+                expected[--out] = literal;
+            }
+        }
+        stream[controlPos] = control;
+    }
+
+    u32 streamSize = (u32)stream.size();
+    u32 compressedSize = prefix + streamSize + 8;
+    compressed.assign(expected.begin(), expected.begin() + prefix);
+    compressed.insert(compressed.end(), stream.rbegin(), stream.rend());
+    u32 footer[2] = {(8u << 24) | (streamSize + 8), total - compressedSize};
+    compressed.insert(compressed.end(), (u8*)footer, (u8*)footer + sizeof(footer));
+}
+
+static u64 NIMChecksum(const u8* data, u32 size)
+{
+    u64 checksum = 0;
+    const u64* start = (const u64*)data, *end = start + size / 8;
+    while (start != end) checksum = (checksum + *start++) * CHECKSUM_MULTIPLIER;
+    return checksum;
+}
+
+static std::vector<BenchCase> MakeCases()
+{
+    std::vector<BenchCase> cases;
+
+    static std::vector<u8> lzssIn, lzssExpected;
+    static std::vector<u64> lzssOutWords((LZSS_DECODED_SIZE + 0x200 + 7) / 8);
+    MakeLZSSInput(LZSS_DECODED_SIZE, lzssIn, lzssExpected);
+    u8* lzssOut = (u8*)lzssOutWords.data();
+    u32 lzssOutSize = ArticFunctions::lzss_get_decompressed_size(lzssIn.data(), (u32)lzssIn.size());
+    if (lzssOutSize != lzssExpected.size() || ArticFunctions::lzss_decompress(lzssIn.data(), (u32)lzssIn.size(), lzssOut, lzssOutSize) ||
+        memcmp(lzssOut, lzssExpected.data(), lzssOutSize)) {
+        fprintf(stderr, "lzss: generated input does not decode as expected\n");
+        exit(1);
+    }
+
+    cases.push_back({"lzss_decompress", 1, lzssOutSize, [=]() {
+        benchSink = ArticFunctions::lzss_decompress(lzssIn.data(), (u32)lzssIn.size(), lzssOut, lzssOutSize);
+    }});
+    cases.push_back({"lzss_decompress_checksum", 1, lzssOutSize, [=]() {
+        u64 checksum;
+        ArticFunctions::lzss_decompress_checksum(lzssIn.data(), (u32)lzssIn.size(), lzssOut, lzssOutSize, CHECKSUM_MULTIPLIER, checksum);
+        benchSink = checksum;
+    }});
+    cases.push_back({"nim_checksum", 1, lzssOutSize, [=]() {
+        benchSink = NIMChecksum(lzssOut, lzssOutSize);
+    }});
+
+    // Same call as the bottom screen logo in main.cpp, and a scaled version of it
+    cases.push_back({"bclim_render_logo", 1, 128 * 128 * 2, []() {
+        BCLIM((void*)__data_logo_bin, __data_logo_bin_size).Render(Rect<int>((320 - 128) / 2, (240 - 128) / 2, 128, 128));
+    }});
+    cases.push_back({"bclim_render_scaled", 1, 128 * 128 * 2, []() {
+        BCLIM((void*)__data_logo_bin, __data_logo_bin_size).Render(Rect<int>(0, 0, 320, 240));
+    }});
+
+    static std::vector<Color> background(COLOR_COUNT), foreground(COLOR_COUNT);
+    std::mt19937 rng(0xC010);
+    for (u32 i = 0; i < COLOR_COUNT; i++) {
+        background[i] = Color((u32)rng());
+        foreground[i] = Color((u32)rng());
+    }
+    const std::pair<const char*, Color::BlendMode> modes[] = {
+        {"color_blend_alpha", Color::BlendMode::Alpha},
+        {"color_blend_add", Color::BlendMode::Add},
+        {"color_blend_sub", Color::BlendMode::Sub},
+        {"color_blend_mul", Color::BlendMode::Mul},
+    };
+    for (auto [name, mode] : modes) {
+        cases.push_back({name, COLOR_COUNT, COLOR_COUNT * sizeof(Color), [mode]() {
+            u32 acc = 0;
+            for (u32 i = 0; i < COLOR_COUNT; i++)
+                acc += background[i].Blend(foreground[i], mode).raw;
+            benchSink = acc;
+        }});
+    }
+
+#ifdef COMPUTE_BENCH_SERVER
+    AddServerCases(cases);
+#endif
+    return cases;
+}
+
+struct CaseResult {
+    u64 iterations;
+    double medianNs, minNs, meanNs, stddevNs;
+};
+
+static double RunOnce(const BenchCase& c, u64 iterations)
+{
+    auto start = Clock::now();
+    for (u64 i = 0; i < iterations; i++)
+        c.run();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static CaseResult Measure(const BenchCase& c, int warmup, int repetitions, double minNs)
+{
+    CaseResult r = {};
+    r.iterations = 1;
+    double elapsed;
+    while ((elapsed = RunOnce(c, r.iterations)) < minNs && r.iterations < (1ULL << 40))
+        r.iterations = std::max(r.iterations * 2, (u64)(r.iterations * minNs / std::max(elapsed, 1.0)));
+
+    for (int i = 0; i < warmup; i++)
+        RunOnce(c, r.iterations);
+
+    std::vector<double> samples;
+    for (int i = 0; i < repetitions; i++)
+        samples.push_back(RunOnce(c, r.iterations) / ((double)r.iterations * c.opsPerRun));
+    std::sort(samples.begin(), samples.end());
+
+    size_t n = samples.size();
+    r.medianNs = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    r.minNs = samples[0];
+    for (double s : samples)
+        r.meanNs += s / n;
+    for (double s : samples)
+        r.stddevNs += (s - r.meanNs) * (s - r.meanNs) / n;
+    r.stddevNs = std::sqrt(r.stddevNs);
+    return r;
+}
+
+// Medians of a previous output, one case per line
+static std::map<std::string, double> ReadBaseline(const char* path)
+{
+    std::map<std::string, double> medians;
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return medians;
+    char line[512];
+    bool inCases = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strstr(line, "\"cases\"")) {
+            inCases = true;
+            continue;
+        }
+        const char* name = strchr(line, '"');
+        const char* median = strstr(line, "\"medianNs\": ");
+        if (!inCases || !name || !median)
+            continue;
+        const char* nameEnd = strchr(name + 1, '"');
+        if (nameEnd)
+            medians[std::string(name + 1, nameEnd)] = strtod(median + 12, nullptr);
+    }
+    fclose(f);
+    return medians;
+}
+
+static const char* Arch()
+{
+#if defined(__arm__)
+    return "arm";
+#elif defined(__aarch64__)
+    return "aarch64";
+#elif defined(__x86_64__)
+    return "x86_64";
+#else
+    return "unknown";
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    int warmup = 3, repetitions = 15;
+    double minMs = 20;
+    const char* filter = nullptr, *baselinePath = nullptr, *output = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:t:f:c:o:h")) != -1) {
+        switch (opt) {
+        case 'w': warmup = std::max(0, atoi(optarg)); break;
+        case 'r': repetitions = std::max(1, atoi(optarg)); break;
+        case 't': minMs = std::max(0.1, atof(optarg)); break;
+        case 'f': filter = optarg; break;
+        case 'c': baselinePath = optarg; break;
+        case 'o': output = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-w warmup] [-r repetitions] [-t ms] [-f filter] [-c baseline.json] [-o out.json]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (baselinePath) {
+        baseline = ReadBaseline(baselinePath);
+        if (baseline.empty()) {
+            fprintf(stderr, "%s: no results found\n", baselinePath);
+            return 1;
+        }
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    fprintf(out, "{\n  \"revision\": \"%s\",\n  \"compiler\": \"%s\",\n  \"arch\": \"%s\",\n", BENCH_REVISION, __VERSION__, Arch());
+    fprintf(out, "  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"minMs\": %g,\n  \"cases\": {", warmup, repetitions, minMs);
+
+    if (baselinePath)
+        fprintf(stderr, "%-28s %12s %12s %8s\n", "case", "base ns/op", "ns/op", "change");
+    bool first = true;
+    for (const BenchCase& c : MakeCases()) {
+        if (filter && !strstr(c.name.c_str(), filter))
+            continue;
+        CaseResult r = Measure(c, warmup, repetitions, minMs * 1e6);
+        double mbs = c.bytesPerRun ? c.bytesPerRun / (r.medianNs * c.opsPerRun) * 1e3 : 0;
+        fprintf(out, "%s\n    \"%s\": {\"iterations\": %llu, \"medianNs\": %.3f, \"minNs\": %.3f, \"meanNs\": %.3f, \"stddevNs\": %.3f, \"mbPerSecond\": %.2f}",
+            first ? "" : ",", c.name.c_str(), (unsigned long long)r.iterations, r.medianNs, r.minNs, r.meanNs, r.stddevNs, mbs);
+        fflush(out);
+        first = false;
+
+        auto it = baseline.find(c.name);
+        if (it != baseline.end())
+            fprintf(stderr, "%-28s %12.3f %12.3f %+7.1f%%\n", c.name.c_str(), it->second, r.medianNs, (r.medianNs / it->second - 1) * 100);
+    }
+    fprintf(out, "\n  }\n}\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
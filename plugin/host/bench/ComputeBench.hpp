@@ -0,0 +1,23 @@
+#pragma once
+#include "3ds.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// One measured kernel. run is called repeatedly, every call does opsPerRun
+// operations over bytesPerRun bytes (0 if throughput makes no sense).
+struct BenchCase {
+    std::string name;
+    u32 opsPerRun;
+    u64 bytesPerRun;
+    std::function<void()> run;
+};
+
+// Results are written here so that the compiler keeps the measured code
+extern volatile u64 benchSink;
+
+#ifdef COMPUTE_BENCH_SERVER
+// ComputeBenchServer.cpp, cases that need the ArticProtocol submodule
+void AddServerCases(std::vector<BenchCase>& cases);
+#endif
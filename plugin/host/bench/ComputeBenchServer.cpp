@@ -0,0 +1,50 @@
+// ComputeBench cases that need the ArticProtocol submodule: the logger and the
+// handler lookup done for every request.
+#include "ComputeBench.hpp"
+#include "Main.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+
+#include "ArticFunctions.hpp"
+
+void AddServerCases(std::vector<BenchCase>& cases) {
+    // The log goes to stdout on the host, keep it out of the results
+    static bool loggerStarted = false;
+    if (!loggerStarted) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            fflush(stdout);
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+        logger.Start();
+        loggerStarted = true;
+    }
+
+    cases.push_back({"logger_debug_disabled", 1, 0, []() {
+        logger.debug_enable = false;
+        logger.Debug("Read 0x%08X bytes at 0x%016llX from handle 0x%08X", 0x40000, 0x123456789ULL, 0x10003);
+    }});
+    cases.push_back({"logger_info", 1, 0, []() {
+        logger.Info("Read 0x%08X bytes at 0x%016llX from handle 0x%08X", 0x40000, 0x123456789ULL, 0x10003);
+    }});
+
+    // Method names arrive in a fixed size packet field
+    static std::vector<std::array<char, 0x20>> methods;
+    for (auto& [name, handler] : ArticFunctions::functionHandlers) {
+        std::array<char, 0x20> method = {};
+        memcpy(method.data(), name.data(), std::min(name.size(), method.size() - 1));
+        methods.push_back(method);
+    }
+    cases.push_back({"handler_lookup", (u32)methods.size(), 0, []() {
+        u64 found = 0;
+        for (const auto& method : methods)
+            found += ArticFunctions::functionHandlers.find(std::string(method.data())) != ArticFunctions::functionHandlers.end();
+        benchSink = found;
+    }});
+}
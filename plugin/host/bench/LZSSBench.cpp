@@ -0,0 +1,251 @@
+// Host benchmark for the .code LZSS decoder.
+//
+// Usage: LZSSBench [-i iterations] [-m mutations] file1.bin [file2.bin ...]
+//
+// Every input must be a compressed code binary (for example the .code section
+// dumped from an ExeFS). Each file is first checked for bit-exact output against
+// the original byte-at-a-time decoder, both as-is and with random corruptions,
+// and then both decoders are timed, alone and together with the NIM checksum
+// (separate pass for the original decoder, fused for the new one).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "LZSS.hpp"
+
+static constexpr u64 CHECKSUM_MULTIPLIER = 0x6500000065ULL;
+
+// Original byte-at-a-time decoder, kept as the reference implementation.
+namespace Reference {
+
+    static u32 getle32(const u8* p)
+    {
+        return (p[0]<<0) | (p[1]<<8) | (p[2]<<16) | (p[3]<<24);
+    }
+
+    static int lzss_decompress(const u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize)
+    {
+        const u8* footer = compressed + compressedsize - 8;
+        u32 buffertopandbottom = getle32(footer+0);
+        u32 i, j;
+        u32 out = decompressedsize;
+        u32 index = compressedsize - ((buffertopandbottom>>24)&0xFF);
+        u32 segmentoffset;
+        u32 segmentsize;
+        u8 control;
+        u32 stopindex = compressedsize - (buffertopandbottom&0xFFFFFF);
+
+        memset(decompressed, 0, decompressedsize);
+        memcpy(decompressed, compressed, compressedsize);
+
+        while(index > stopindex)
+        {
+            control = compressed[--index];
+
+            for(i=0; i<8; i++)
+            {
+                if (index <= stopindex)
+                    break;
+                if (index <= 0)
+                    break;
+                if (out <= 0)
+                    break;
+
+                if (control & 0x80)
+                {
+                    if (index < 2)
+                        return -1;
+
+                    index -= 2;
+
+                    segmentoffset = compressed[index] | (compressed[index+1]<<8);
+                    segmentsize = ((segmentoffset >> 12)&15)+3;
+                    segmentoffset &= 0x0FFF;
+                    segmentoffset += 2;
+
+                    if (out < segmentsize)
+                        return -1;
+
+                    for(j=0; j<segmentsize; j++)
+                    {
+                        u8 data;
+                        if (out+segmentoffset >= decompressedsize)
+                            return -1;
+                        data  = decompressed[out+segmentoffset];
+                        decompressed[--out] = data;
+                    }
+                }
+                else
+                {
+                    if (out < 1)
+                        return -1;
+                    decompressed[--out] = compressed[--index];
+                }
+
+                control <<= 1;
+            }
+        }
+
+        return 0;
+    }
+
+    // The reference decoder reads outside of the input for these footers, skip them.
+    static bool IsDefined(const std::vector<u8>& in, u32 outSize)
+    {
+        if (in.size() < 8 || outSize < in.size())
+            return false;
+        u32 btb = getle32(in.data() + in.size() - 8);
+        u32 index = (u32)in.size() - ((btb>>24)&0xFF);
+        u32 stopindex = (u32)in.size() - (btb&0xFFFFFF);
+        return !(index > stopindex && index > in.size());
+    }
+
+    static u64 checksum(const u8* data, u32 size)
+    {
+        volatile u64 checksum = 0;
+        const u64* start = (const u64*)data, *end = (const u64*)((uintptr_t)(data + size) & ~7);
+        while (start != end) checksum = (checksum + *start++) * CHECKSUM_MULTIPLIER;
+        return checksum;
+    }
+}
+
+static bool ReadFile(const char* path, std::vector<u8>& out)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size > 0 ? size : 0);
+    bool good = size > 0 && fread(out.data(), 1, out.size(), f) == out.size();
+    fclose(f);
+    return good;
+}
+
+static bool CheckExact(const std::vector<u8>& in, u32 outSize)
+{
+    if (!Reference::IsDefined(in, outSize))
+        return true;
+    std::vector<u8> expected(outSize), actual(outSize, 0xCD), fused(outSize, 0xCD);
+    int expectedRes = Reference::lzss_decompress(in.data(), (u32)in.size(), expected.data(), outSize);
+    int actualRes = ArticFunctions::lzss_decompress(in.data(), (u32)in.size(), actual.data(), outSize);
+    u64 fusedChecksum;
+    int fusedRes = ArticFunctions::lzss_decompress_checksum(in.data(), (u32)in.size(), fused.data(), outSize, CHECKSUM_MULTIPLIER, fusedChecksum);
+    return expectedRes == actualRes && expected == actual && expectedRes == fusedRes && expected == fused &&
+        fusedChecksum == Reference::checksum(expected.data(), outSize);
+}
+
+template <typename F>
+static double MeasureMBs(F&& decode, u32 outSize, int iterations)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        decode();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)outSize * iterations / elapsed.count() / (1000. * 1000.);
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 20;
+    int mutations = 2000;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            iterations = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            mutations = atoi(argv[++i]);
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        fprintf(stderr, "Usage: %s [-i iterations] [-m mutations] file1.bin [file2.bin ...]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937 rng(0x3D5);
+    bool allGood = true;
+
+    printf("%-32s %10s %12s %12s %8s %12s %12s %8s\n", "file", "size", "old MB/s", "new MB/s", "speedup",
+        "old+sum", "fused", "speedup");
+    for (const char* path : files) {
+        std::vector<u8> in;
+        if (!ReadFile(path, in)) {
+            fprintf(stderr, "%s: cannot read\n", path);
+            allGood = false;
+            continue;
+        }
+        u32 outSize = ArticFunctions::lzss_get_decompressed_size(in.data(), (u32)in.size());
+        if (in.size() <= 8 || outSize < in.size()) {
+            fprintf(stderr, "%s: not a compressed code binary\n", path);
+            allGood = false;
+            continue;
+        }
+
+        if (!CheckExact(in, outSize)) {
+            fprintf(stderr, "%s: output mismatch\n", path);
+            allGood = false;
+            continue;
+        }
+
+        int mismatches = 0;
+        for (int m = 0; m < mutations; m++) {
+            std::vector<u8> bad = in;
+            u32 badOutSize = outSize;
+            switch (rng() % 4) {
+            case 0: // Random byte flips in the compressed stream
+                for (int k = 0; k < 4; k++)
+                    bad[rng() % bad.size()] ^= 1 << (rng() % 8);
+                break;
+            case 1: // Truncated stream, keeping the original footer
+                bad.erase(bad.begin() + rng() % (bad.size() - 8), bad.end() - 8);
+                badOutSize = ArticFunctions::lzss_get_decompressed_size(bad.data(), (u32)bad.size());
+                break;
+            case 2: // Corrupted footer
+                bad[bad.size() - 8 + rng() % 8] = (u8)rng();
+                break;
+            case 3: // Undersized output buffer
+                badOutSize = (u32)bad.size() + rng() % (outSize - (u32)bad.size() + 1);
+                break;
+            }
+            if (!CheckExact(bad, badOutSize))
+                mismatches++;
+        }
+        if (mismatches) {
+            fprintf(stderr, "%s: %d/%d corrupted inputs mismatch\n", path, mismatches, mutations);
+            allGood = false;
+            continue;
+        }
+
+        std::vector<u64> outWords((outSize + 7) / 8);
+        u8* out = reinterpret_cast<u8*>(outWords.data());
+        volatile u64 checksum = 0;
+        double oldMBs = MeasureMBs([&]() {
+            Reference::lzss_decompress(in.data(), (u32)in.size(), out, outSize);
+        }, outSize, iterations);
+        double newMBs = MeasureMBs([&]() {
+            ArticFunctions::lzss_decompress(in.data(), (u32)in.size(), out, outSize);
+        }, outSize, iterations);
+        double oldSumMBs = MeasureMBs([&]() {
+            Reference::lzss_decompress(in.data(), (u32)in.size(), out, outSize);
+            checksum = Reference::checksum(out, outSize);
+        }, outSize, iterations);
+        double fusedMBs = MeasureMBs([&]() {
+            u64 c;
+            ArticFunctions::lzss_decompress_checksum(in.data(), (u32)in.size(), out, outSize, CHECKSUM_MULTIPLIER, c);
+            checksum = c;
+        }, outSize, iterations);
+
+        const char* name = strrchr(path, '/');
+        printf("%-32s %10u %12.2f %12.2f %7.2fx %12.2f %12.2f %7.2fx\n", name ? name + 1 : path, outSize,
+            oldMBs, newMBs, newMBs / oldMBs, oldSumMBs, fusedMBs, fusedMBs / oldSumMBs);
+    }
+
+    return allGood ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+#include "LinkShaper.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Data is scheduled per TCP segment
+static constexpr size_t SEGMENT_SIZE = 1460;
+static constexpr size_t READ_SIZE = 0x10000;
+
+// Rough 3DS Wi-Fi conditions next to the access point and a few rooms away
+static const LinkProfile GOOD_WIFI = {4, 1500, 1, 0.1, 20};
+static const LinkProfile BAD_WIFI = {30, 250, 15, 2, 200};
+
+std::string LinkProfile::Describe() const {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "rtt=%g,bw=%g,jitter=%g,loss=%g,retransmit=%g", rttMs, bandwidthKBps, jitterMs, lossPercent, retransmitMs);
+    return buf;
+}
+
+bool LinkProfile::Parse(const std::string& spec, LinkProfile& out) {
+    out = LinkProfile();
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos)
+            end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        start = end + 1;
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            if (item == "none") out = LinkProfile();
+            else if (item == "good") out = GOOD_WIFI;
+            else if (item == "bad") out = BAD_WIFI;
+            else return false;
+            continue;
+        }
+        std::string key = item.substr(0, eq);
+        char* valueEnd;
+        double value = strtod(item.c_str() + eq + 1, &valueEnd);
+        if (*valueEnd || value < 0)
+            return false;
+        if (key == "rtt") out.rttMs = value;
+        else if (key == "bw") out.bandwidthKBps = value;
+        else if (key == "jitter") out.jitterMs = value;
+        else if (key == "loss") out.lossPercent = std::min(value, 100.0);
+        else if (key == "retransmit") out.retransmitMs = value;
+        else return false;
+    }
+    return true;
+}
+
+namespace {
+
+    struct Segment {
+        Clock::time_point due;
+        std::vector<u8> data;
+    };
+
+    // One shaped connection, alive while either direction is forwarding
+    struct Link {
+        LinkProfile profile;
+        int localFD;
+        int remoteFD;
+        std::mutex mediumMutex;
+        Clock::time_point mediumFree;
+        std::mt19937 random{1};
+
+        ~Link() {
+            close(localFD);
+            close(remoteFD);
+        }
+
+        // Time the segment is delivered to the other end if sent now
+        Clock::time_point Schedule(size_t size, Clock::time_point now) {
+            std::lock_guard<std::mutex> l(mediumMutex);
+            Clock::time_point sent = std::max(now, mediumFree);
+            if (profile.bandwidthKBps)
+                sent += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(size / (profile.bandwidthKBps * 1000)));
+            mediumFree = sent;
+
+            double delayMs = profile.rttMs / 2;
+            if (profile.jitterMs)
+                delayMs = std::max(0.0, delayMs + std::uniform_real_distribution<double>(-profile.jitterMs, profile.jitterMs)(random));
+            if (profile.lossPercent && std::uniform_real_distribution<double>(0, 100)(random) < profile.lossPercent)
+                delayMs += profile.retransmitMs;
+            return sent + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(delayMs));
+        }
+    };
+
+    static bool WriteAll(int fd, const u8* data, size_t size) {
+        while (size) {
+            ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    // Forwards from one end to the other, delivering every segment at its due time
+    static void Forward(std::shared_ptr<Link> link, int from, int to) {
+        std::deque<Segment> queue;
+        Clock::time_point lastDue;
+        std::vector<u8> buf(READ_SIZE);
+        bool open = true;
+
+        while (open || !queue.empty()) {
+            int timeout = -1;
+            if (!queue.empty()) {
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(queue.front().due - Clock::now());
+                timeout = (int)std::max<s64>(wait.count(), 0);
+            }
+            pollfd pfd = {from, POLLIN, 0};
+            int ready = open ? poll(&pfd, 1, timeout) : 0;
+            if (!open && timeout > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+
+            if (ready > 0) {
+                ssize_t got = recv(from, buf.data(), buf.size(), 0);
+                if (got < 0 && errno == EINTR)
+                    continue;
+                if (got <= 0) {
+                    open = false;
+                } else {
+                    Clock::time_point now = Clock::now();
+                    for (ssize_t off = 0; off < got; off += SEGMENT_SIZE) {
+                        size_t size = std::min<size_t>(SEGMENT_SIZE, got - off);
+                        // Delivered in order, a late segment holds back the next ones
+                        lastDue = std::max(lastDue, link->Schedule(size, now));
+                        queue.push_back({lastDue, std::vector<u8>(buf.data() + off, buf.data() + off + size)});
+                    }
+                }
+            }
+
+            Clock::time_point now = Clock::now();
+            while (!queue.empty() && queue.front().due <= now) {
+                if (!WriteAll(to, queue.front().data.data(), queue.front().data.size())) {
+                    queue.clear();
+                    open = false;
+                    shutdown(from, SHUT_RD);
+                    break;
+                }
+                queue.pop_front();
+            }
+        }
+        shutdown(to, SHUT_WR);
+    }
+}
+
+int LinkShaper::Wrap(int fd) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair)) {
+        close(fd);
+        return -1;
+    }
+
+    auto link = std::make_shared<Link>();
+    link->profile = profile;
+    link->localFD = pair[1];
+    link->remoteFD = fd;
+    std::thread(Forward, link, link->localFD, link->remoteFD).detach();
+    std::thread(Forward, link, link->remoteFD, link->localFD).detach();
+    return pair[0];
+}
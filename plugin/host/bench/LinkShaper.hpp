@@ -0,0 +1,39 @@
+#pragma once
+#include "3ds.h"
+
+#include <string>
+
+// Conditions of the emulated link, the same in both directions
+struct LinkProfile {
+    double rttMs = 0;
+    // Shared by both directions like the 802.11 medium, 0 is unlimited
+    double bandwidthKBps = 0;
+    // Added to half the RTT of every segment, uniform in [-jitter, +jitter]
+    double jitterMs = 0;
+    double lossPercent = 0;
+    // Extra delay of a lost segment, later segments wait for it like in TCP
+    double retransmitMs = 0;
+
+    bool IsNone() const { return !rttMs && !bandwidthKBps && !jitterMs && !lossPercent; }
+    std::string Describe() const;
+
+    // "none", "good", "bad" or a profile followed by overrides, for example
+    // "bad,rtt=50" or "rtt=10,bw=1500,jitter=2,loss=0.5,retransmit=200" (bw in KB/s)
+    static bool Parse(const std::string& spec, LinkProfile& out);
+};
+
+// In-process link emulator for the host benchmarks. Wrap takes a connected socket
+// and returns a socket for the client end, the data between both is forwarded by
+// two threads that hold back every segment as it would be on the profile's link.
+class LinkShaper {
+public:
+    explicit LinkShaper(const LinkProfile& profile) : profile(profile) {}
+
+    // Takes ownership of fd, returns -1 on failure (fd is closed)
+    int Wrap(int fd);
+
+    const LinkProfile& GetProfile() const { return profile; }
+
+private:
+    LinkProfile profile;
+};
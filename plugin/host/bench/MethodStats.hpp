@@ -0,0 +1,55 @@
+#pragma once
+#include "3ds.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// Per method latency and throughput of a benchmark run, printed as JSON
+struct MethodStats {
+    std::vector<double> latenciesUs;
+    u32 errors = 0;
+    u64 bytes = 0;
+};
+
+using MethodStatsMap = std::map<std::string, MethodStats>;
+
+static inline double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Prints the run totals followed by the given extra fields and the methods
+static inline void PrintStatsJSON(FILE* out, MethodStatsMap& stats, double seconds, const std::vector<std::pair<std::string, std::string>>& fields) {
+    u64 totalBytes = 0;
+    size_t totalRequests = 0;
+    for (auto& [name, s] : stats) {
+        totalBytes += s.bytes;
+        totalRequests += s.latenciesUs.size();
+    }
+
+    fprintf(out, "{\n");
+    for (auto& [key, value] : fields)
+        fprintf(out, "  \"%s\": %s,\n", key.c_str(), value.c_str());
+    fprintf(out, "  \"seconds\": %.6f,\n  \"bytes\": %llu,\n  \"requests\": %zu,\n", seconds, (unsigned long long)totalBytes, totalRequests);
+    fprintf(out, "  \"mbPerSecond\": %.3f,\n  \"requestsPerSecond\": %.1f,\n  \"methods\": {",
+        seconds ? totalBytes / seconds / 1e6 : 0, seconds ? totalRequests / seconds : 0);
+
+    bool first = true;
+    for (auto& [name, s] : stats) {
+        std::sort(s.latenciesUs.begin(), s.latenciesUs.end());
+        double busy = 0;
+        for (double l : s.latenciesUs)
+            busy += l;
+        fprintf(out, "%s\n    \"%s\": {\"count\": %zu, \"errors\": %u, \"bytes\": %llu, \"mbPerSecond\": %.3f, "
+            "\"meanUs\": %.1f, \"p50Us\": %.1f, \"p99Us\": %.1f}", first ? "" : ",", name.c_str(), s.latenciesUs.size(),
+            s.errors, (unsigned long long)s.bytes, busy ? s.bytes / busy : 0, busy / std::max<size_t>(s.latenciesUs.size(), 1),
+            Percentile(s.latenciesUs, 0.5), Percentile(s.latenciesUs, 0.99));
+        first = false;
+    }
+    fprintf(out, "\n  }\n}\n");
+}
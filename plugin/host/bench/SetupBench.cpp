@@ -0,0 +1,210 @@
+// End to end benchmark of a setup session. Connects to a plugin server (usually the
+// host build over loopback), issues the requests Azahar does on "Set Up System Files"
+// and prints per method latency and throughput as JSON.
+#include "ArticClient.hpp"
+#include "MethodStats.hpp"
+#include "Bottleneck.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+static constexpr s32 SETUP_APP_VERSION = 2;
+static constexpr s8 SYSTEM_FILE_COUNT = 6;
+static constexpr u32 DIR_ENTRIES_PER_READ = 32;
+
+using Clock = std::chrono::steady_clock;
+
+static MethodStatsMap stats;
+static ArticClient client;
+// Server side phase times of all sessions, from System_GetBottleneck
+static u64 phaseUs[ArticFunctions::Bottleneck::PHASE_COUNT];
+
+static bool Call(const std::string& method, const std::vector<ArticClient::Param>& params, ArticClient::Response& resp) {
+    auto start = Clock::now();
+    if (!client.Call(method, params, resp)) {
+        fprintf(stderr, "%s: %s\n", method.c_str(), client.GetError().c_str());
+        exit(1);
+    }
+    MethodStats& s = stats[method];
+    s.latenciesUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    s.bytes += resp.wireBytes;
+    if (!resp.Good())
+        s.errors++;
+    return resp.Good();
+}
+
+template <typename T>
+static bool Get(const ArticClient::Response& resp, T& out) {
+    const std::vector<u8>* buf = resp.Get(0);
+    if (!buf || buf->size() < sizeof(T))
+        return false;
+    memcpy(&out, buf->data(), sizeof(T));
+    return true;
+}
+
+static void ReadFile(u64 archive, const std::string& path, u32 chunkSize) {
+    ArticClient::Response resp;
+    s32 file = 0;
+    if (!Call("FSUSER_OpenFile", {ArticClient::S64(archive), ArticClient::FSPath(path.c_str()), ArticClient::S32(FS_OPEN_READ), ArticClient::S32(0)}, resp) ||
+        !Get(resp, file)) {
+        fprintf(stderr, "Cannot open %s: 0x%08X\n", path.c_str(), resp.methodResult);
+        return;
+    }
+
+    u64 size = 0;
+    if (Call("FSFILE_GetSize", {ArticClient::S32(file)}, resp))
+        Get(resp, size);
+
+    for (u64 offset = 0; offset < size;) {
+        if (!Call("FSFILE_Read", {ArticClient::S32(file), ArticClient::S64(offset), ArticClient::S32(chunkSize)}, resp))
+            break;
+        const std::vector<u8>* data = resp.Get(0);
+        if (!data || data->empty())
+            break;
+        offset += data->size();
+    }
+    Call("FSFILE_Close", {ArticClient::S32(file)}, resp);
+}
+
+static std::vector<std::string> ListFiles(u64 archive, const std::string& dir) {
+    std::vector<std::string> files;
+    ArticClient::Response resp;
+    s32 handle = 0;
+    if (!Call("FSUSER_OpenDirectory", {ArticClient::S64(archive), ArticClient::FSPath(dir.c_str())}, resp) || !Get(resp, handle))
+        return files;
+
+    while (Call("FSDIR_Read", {ArticClient::S32(handle), ArticClient::S32(DIR_ENTRIES_PER_READ)}, resp)) {
+        const std::vector<u8>* data = resp.Get(0);
+        if (!data || data->size() < sizeof(FS_DirectoryEntry))
+            break;
+        for (size_t i = 0; i + sizeof(FS_DirectoryEntry) <= data->size(); i += sizeof(FS_DirectoryEntry)) {
+            FS_DirectoryEntry entry;
+            memcpy(&entry, data->data() + i, sizeof(entry));
+            if (entry.attributes & FS_ATTRIBUTE_DIRECTORY)
+                continue;
+            std::string name;
+            for (u16 c : entry.name) {
+                if (!c)
+                    break;
+                name += c < 0x80 ? (char)c : '_';
+            }
+            files.push_back((dir == "/" ? "/" : dir + "/") + name);
+        }
+    }
+    Call("FSDIR_Close", {ArticClient::S32(handle)}, resp);
+    return files;
+}
+
+static void RunSession(const std::vector<std::string>& files, const std::string& dir, u32 chunkSize) {
+    ArticClient::Response resp;
+    Call("System_ArticSetupVersion", {ArticClient::S32(SETUP_APP_VERSION)}, resp);
+    for (s8 type = 0; type < SYSTEM_FILE_COUNT; type++)
+        Call("System_GetSystemFile", {ArticClient::S8(type)}, resp);
+
+    u64 archive = 0;
+    if (Call("FSUSER_OpenArchive", {ArticClient::S32(ARCHIVE_SDMC), ArticClient::FSPath("")}, resp) && Get(resp, archive)) {
+        std::vector<std::string> toRead = files.empty() ? ListFiles(archive, dir) : files;
+        for (const std::string& file : toRead)
+            ReadFile(archive, file, chunkSize);
+        Call("FSUSER_CloseArchive", {ArticClient::S64(archive)}, resp);
+    }
+
+    Call("System_GetNIM", {}, resp);
+
+    // Not part of a setup, kept out of the method stats
+    ArticFunctions::Bottleneck::Summary summary;
+    if (client.Call("System_GetBottleneck", {}, resp) && resp.Good() && Get(resp, summary)) {
+        for (int i = 0; i < ArticFunctions::Bottleneck::PHASE_COUNT; i++)
+            phaseUs[i] += summary.phaseUs[i];
+    }
+}
+
+static std::string BottleneckJSON() {
+    using namespace ArticFunctions::Bottleneck;
+    u64 cpu = phaseUs[PHASE_PREP];
+    u64 total = cpu + phaseUs[PHASE_FS] + phaseUs[PHASE_SEND];
+    u8 verdict = VERDICT_NONE;
+    if (total)
+        verdict = (phaseUs[PHASE_FS] >= phaseUs[PHASE_SEND] && phaseUs[PHASE_FS] >= cpu) ? VERDICT_FS :
+            (phaseUs[PHASE_SEND] >= cpu ? VERDICT_NETWORK : VERDICT_CPU);
+    char buf[256];
+    snprintf(buf, sizeof(buf), "{\"verdict\": \"%s\", \"fsUs\": %llu, \"prepUs\": %llu, \"sendUs\": %llu}",
+        VerdictName(verdict), (unsigned long long)phaseUs[PHASE_FS], (unsigned long long)phaseUs[PHASE_PREP],
+        (unsigned long long)phaseUs[PHASE_SEND]);
+    return buf;
+}
+
+static void Usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [-a address] [-p port] [-s sessions] [-c chunk] [-d dir] [-l link] [-o out.json] [file...]\n"
+        "  Reads the given SD card files, or every file in -d (default /), on each session.\n"
+        "  -l  Emulated link: none, good, bad or rtt=ms,bw=KB/s,jitter=ms,loss=%%,retransmit=ms\n", name);
+}
+
+int main(int argc, char* argv[]) {
+    std::string address = "127.0.0.1", dir = "/", output;
+    int port = 5543, sessions = 1;
+    u32 chunkSize = 0x40000;
+    LinkProfile link;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:s:c:d:l:o:h")) != -1) {
+        switch (opt) {
+        case 'a': address = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 's': sessions = std::max(1, atoi(optarg)); break;
+        case 'c': chunkSize = (u32)strtoul(optarg, nullptr, 0); break;
+        case 'd': dir = optarg; break;
+        case 'l':
+            if (!LinkProfile::Parse(optarg, link)) {
+                fprintf(stderr, "Invalid link profile: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o': output = optarg; break;
+        default: Usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    std::vector<std::string> files(argv + optind, argv + argc);
+
+    LinkShaper shaper(link);
+    if (!link.IsNone())
+        client.SetLinkShaper(&shaper);
+
+    // Each session is a new connection, like pressing "Set Up System Files" again.
+    // The server only listens again after its disconnect cleanup, so retry for a while.
+    double seconds = 0;
+    for (int i = 0; i < sessions; i++) {
+        bool connected = false;
+        for (int retry = 0; retry < 50 && !(connected = client.Connect(address, port)); retry++)
+            usleep(100000);
+        if (!connected) {
+            fprintf(stderr, "%s\n", client.GetError().c_str());
+            return 1;
+        }
+        auto start = Clock::now();
+        RunSession(files, dir, chunkSize);
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        client.Close();
+    }
+
+    FILE* out = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (!out) {
+        perror(output.c_str());
+        return 1;
+    }
+    PrintStatsJSON(out, stats, seconds, {
+        {"server", "\"" + address + ":" + std::to_string(port) + "\""},
+        {"link", "\"" + link.Describe() + "\""},
+        {"sessions", std::to_string(sessions)},
+        {"chunkSize", std::to_string(chunkSize)},
+        {"bottleneck", BottleneckJSON()},
+    });
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
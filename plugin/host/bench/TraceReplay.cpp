@@ -0,0 +1,214 @@
+// Replays a session trace recorded by the plugin (see SessionTrace.hpp) against a
+// server, at the original pacing or as fast as possible, and prints per method
+// latency and throughput as JSON like SetupBench.
+#include "ArticClient.hpp"
+#include "MethodStats.hpp"
+#include "SessionTrace.hpp"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+using namespace ArticFunctions;
+using Clock = std::chrono::steady_clock;
+
+struct TracedRequest {
+    SessionTrace::RequestRecord header;
+    std::string method;
+    std::vector<ArticClient::Param> params;
+    u64 handle = 0;
+};
+
+using TracedSession = std::vector<TracedRequest>;
+
+static bool Parse(const std::vector<u8>& data, std::vector<TracedSession>& sessions) {
+    size_t pos = 0;
+    auto take = [&](void* out, size_t size) {
+        if (data.size() - pos < size)
+            return false;
+        memcpy(out, data.data() + pos, size);
+        pos += size;
+        return true;
+    };
+
+    SessionTrace::FileHeader fileHeader;
+    if (!take(&fileHeader, sizeof(fileHeader)) || fileHeader.magic != SessionTrace::TRACE_MAGIC ||
+        fileHeader.version != SessionTrace::TRACE_VERSION)
+        return false;
+
+    while (pos < data.size()) {
+        u8 type = data[pos];
+        if (type == SessionTrace::RECORD_SESSION) {
+            pos++;
+            sessions.emplace_back();
+            continue;
+        }
+        if (type != SessionTrace::RECORD_REQUEST || sessions.empty())
+            return false;
+
+        TracedRequest req;
+        if (!take(&req.header, sizeof(req.header)))
+            return false;
+        req.method.resize(req.header.methodLength);
+        if (!take(req.method.data(), req.method.size()))
+            return false;
+
+        for (u8 i = 0; i < req.header.parameterCount; i++) {
+            u8 paramType;
+            s64 value = 0;
+            if (!take(&paramType, 1))
+                return false;
+            switch (paramType) {
+            case SessionTrace::PARAMETER_S8: { s8 v; if (!take(&v, 1)) return false; value = v; break; }
+            case SessionTrace::PARAMETER_S16: { s16 v; if (!take(&v, 2)) return false; value = v; break; }
+            case SessionTrace::PARAMETER_S32: { s32 v; if (!take(&v, 4)) return false; value = v; break; }
+            case SessionTrace::PARAMETER_S64: { if (!take(&value, 8)) return false; break; }
+            case SessionTrace::PARAMETER_BUFFER: {
+                u16 size;
+                if (!take(&size, 2) || data.size() - pos < size)
+                    return false;
+                req.params.push_back(ArticClient::Buffer(data.data() + pos, size));
+                pos += size;
+                continue;
+            }
+            default:
+                return false;
+            }
+            req.params.push_back({(ArticProtocolCommon::RequestParameterType)paramType, value, {}});
+        }
+        if (req.header.handleSize && !take(&req.handle, req.header.handleSize))
+            return false;
+        sessions.back().push_back(std::move(req));
+    }
+    return true;
+}
+
+static void Usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [-a address] [-p port] [-f] [-l link] [-o out.json] trace.bin\n"
+        "  -f  Replay as fast as possible instead of at the recorded pacing\n"
+        "  -l  Emulated link: none, good, bad or rtt=ms,bw=KB/s,jitter=ms,loss=%%,retransmit=ms\n", name);
+}
+
+int main(int argc, char* argv[]) {
+    std::string address = "127.0.0.1", output;
+    int port = 5543;
+    bool fast = false;
+    LinkProfile link;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:fl:o:h")) != -1) {
+        switch (opt) {
+        case 'a': address = optarg; break;
+        case 'p': port = atoi(optarg); break;
+        case 'f': fast = true; break;
+        case 'l':
+            if (!LinkProfile::Parse(optarg, link)) {
+                fprintf(stderr, "Invalid link profile: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o': output = optarg; break;
+        default: Usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(argv[optind], std::ios::binary);
+    std::vector<u8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<TracedSession> sessions;
+    if (!file.good() && !file.eof()) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (!Parse(data, sessions)) {
+        fprintf(stderr, "%s: invalid or truncated trace, replaying the complete requests\n", argv[optind]);
+    }
+
+    MethodStatsMap stats;
+    LinkShaper shaper(link);
+    ArticClient client;
+    if (!link.IsNone())
+        client.SetLinkShaper(&shaper);
+    u32 mismatches = 0;
+    double seconds = 0, recordedSeconds = 0;
+    for (const TracedSession& session : sessions) {
+        bool connected = false;
+        for (int retry = 0; retry < 50 && !(connected = client.Connect(address, port)); retry++)
+            usleep(100000);
+        if (!connected) {
+            fprintf(stderr, "%s\n", client.GetError().c_str());
+            return 1;
+        }
+
+        // Handles returned by opens in the trace, mapped to the ones of this replay.
+        // Handlers take the handle they use as the first parameter.
+        std::map<u64, s64> handles;
+        auto start = Clock::now();
+        u64 offsetUs = 0;
+        for (const TracedRequest& req : session) {
+            offsetUs += req.header.gapUs;
+            if (!fast)
+                std::this_thread::sleep_until(start + std::chrono::microseconds(offsetUs));
+
+            std::vector<ArticClient::Param> params = req.params;
+            if (!params.empty() && params[0].buffer.empty()) {
+                auto it = handles.find((u64)params[0].value);
+                if (it != handles.end())
+                    params[0].value = it->second;
+            }
+
+            ArticClient::Response resp;
+            auto callStart = Clock::now();
+            if (!client.Call(req.method, params, resp)) {
+                fprintf(stderr, "%s: %s\n", req.method.c_str(), client.GetError().c_str());
+                return 1;
+            }
+            MethodStats& s = stats[req.method];
+            s.latenciesUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - callStart).count());
+            s.bytes += resp.wireBytes;
+            if (!resp.Good())
+                s.errors++;
+
+            bool recordedGood = req.header.status == SessionTrace::STATUS_GOOD;
+            bool replayedGood = resp.articResult == ArticProtocolCommon::ArticResult::SUCCESS;
+            if (recordedGood != replayedGood || (replayedGood && resp.methodResult != req.header.result))
+                mismatches++;
+
+            const std::vector<u8>* result = resp.Get(0);
+            // Only set by the methods that open handles, which return them in buffer 0
+            if (req.header.handleSize && result && result->size() == req.header.handleSize) {
+                s64 value = 0;
+                memcpy(&value, result->data(), result->size());
+                handles[req.handle] = value;
+            }
+        }
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        if (!session.empty())
+            recordedSeconds += (offsetUs + session.back().header.durationUs) / 1e6;
+        client.Close();
+    }
+
+    FILE* out = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (!out) {
+        perror(output.c_str());
+        return 1;
+    }
+    PrintStatsJSON(out, stats, seconds, {
+        {"server", "\"" + address + ":" + std::to_string(port) + "\""},
+        {"link", "\"" + link.Describe() + "\""},
+        {"sessions", std::to_string(sessions.size())},
+        {"pacing", fast ? "\"fast\"" : "\"recorded\""},
+        {"recordedSeconds", std::to_string(recordedSeconds)},
+        {"resultMismatches", std::to_string(mismatches)},
+    });
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,318 @@
+#pragma once
+// Host stand-in for libctru, only covering what the plugin and ArticProtocol use.
+// Implemented in host/shim, see host/README.md for how FS archives are mapped.
+
+#include "3ds/types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// result.h
+#define R_SUCCEEDED(res)   ((res)>=0)
+#define R_FAILED(res)      ((res)<0)
+#define R_LEVEL(res)       (((res)>>27)&0x1F)
+#define R_SUMMARY(res)     (((res)>>21)&0x3F)
+#define R_MODULE(res)      (((res)>>10)&0xFF)
+#define R_DESCRIPTION(res) ((res)&0x3FF)
+#define MAKERESULT(level,summary,module,description) \
+    ((((level)&0x1F)<<27) | (((summary)&0x3F)<<21) | (((module)&0xFF)<<10) | ((description)&0x3FF))
+
+enum { RL_SUCCESS = 0, RL_INFO = 1, RL_FATAL = 0x1F, RL_RESET = 0x1E, RL_REINITIALIZE = 0x1D, RL_USAGE = 0x1C, RL_PERMANENT = 0x1B, RL_TEMPORARY = 0x1A, RL_STATUS = 0x19 };
+enum { RS_SUCCESS = 0, RS_NOP = 1, RS_WOULDBLOCK = 2, RS_OUTOFRESOURCE = 3, RS_NOTFOUND = 4, RS_INVALIDSTATE = 5, RS_NOTSUPPORTED = 6, RS_INVALIDARG = 7, RS_WRONGARG = 8, RS_CANCELED = 9, RS_STATUSCHANGED = 10, RS_INTERNAL = 11, RS_INVALIDRESVAL = 63 };
+enum { RM_COMMON = 0, RM_KERNEL = 1, RM_FS = 17, RM_APPLICATION = 254 };
+enum { RD_SUCCESS = 0, RD_INVALID_RESULT_VALUE = 0x3FF, RD_TIMEOUT = 0x3FE, RD_OUT_OF_RANGE = 0x3FD, RD_ALREADY_EXISTS = 0x3FC, RD_CANCEL_REQUESTED = 0x3FB, RD_NOT_FOUND = 0x3FA, RD_ALREADY_INITIALIZED = 0x3F9, RD_NOT_INITIALIZED = 0x3F8, RD_INVALID_HANDLE = 0x3F7, RD_INVALID_POINTER = 0x3F6, RD_INVALID_ADDRESS = 0x3F5, RD_NOT_IMPLEMENTED = 0x3F4, RD_OUT_OF_MEMORY = 0x3F3, RD_MISALIGNED_SIZE = 0x3F2, RD_MISALIGNED_ADDRESS = 0x3F1, RD_BUSY = 0x3F0, RD_NO_DATA = 0x3EF, RD_INVALID_COMBINATION = 0x3EE, RD_INVALID_ENUM_VALUE = 0x3ED, RD_INVALID_SIZE = 0x3EC, RD_ALREADY_DONE = 0x3EB, RD_NOT_AUTHORIZED = 0x3EA, RD_TOO_LARGE = 0x3E9, RD_INVALID_SELECTION = 0x3E8 };
+
+// svc.h
+#define CUR_PROCESS_HANDLE 0xFFFF8001
+#define CUR_THREAD_HANDLE  0xFFFF8000
+
+typedef enum {
+    MEMOP_FREE = 1,
+    MEMOP_RESERVE = 2,
+    MEMOP_ALLOC = 3,
+    MEMOP_MAP = 4,
+    MEMOP_UNMAP = 5,
+    MEMOP_PROT = 6,
+} MemOp;
+
+typedef enum {
+    MEMPERM_READ = 1,
+    MEMPERM_WRITE = 2,
+    MEMPERM_EXECUTE = 4,
+    MEMPERM_READWRITE = MEMPERM_READ | MEMPERM_WRITE,
+    MEMPERM_READEXECUTE = MEMPERM_READ | MEMPERM_EXECUTE,
+    MEMPERM_DONTCARE = 0x10000000,
+} MemPerm;
+
+Result svcCloseHandle(Handle handle);
+Result svcSendSyncRequest(Handle session);
+Result svcGetProcessId(u32* out, Handle handle);
+Result svcGetProcessInfo(s64* out, Handle process, u32 type);
+Result svcGetThreadPriority(s32* out, Handle handle);
+Result svcGetThreadId(u32* out, Handle handle);
+Result svcGetSystemInfo(s64* out, u32 type, s32 param);
+void svcSleepThread(s64 ns);
+u64 svcGetSystemTick(void);
+
+static inline u32* getThreadLocalStorage(void)
+{
+    static __thread u32 tls[0x80];
+    return tls;
+}
+static inline u32* getThreadCommandBuffer(void) { return getThreadLocalStorage() + 0x20; }
+static inline u32* getThreadStaticBuffers(void) { return getThreadLocalStorage() + 0x40; }
+
+// ipc.h
+static inline u32 IPC_MakeHeader(u16 command_id, unsigned normal_params, unsigned translate_params)
+{
+    return ((u32)command_id << 16) | (((u32)normal_params & 0x3F) << 6) | (((u32)translate_params & 0x3F) << 0);
+}
+static inline u32 IPC_Desc_StaticBuffer(size_t size, unsigned buffer_id)
+{
+    return (size << 14) | ((buffer_id & 0xF) << 10) | 0x2;
+}
+
+// synchronization.h
+typedef s32 LightLock;
+typedef struct {
+    LightLock lock;
+    u32 thread_tag;
+    u32 counter;
+} RecursiveLock;
+typedef struct {
+    s32 state;
+    LightLock lock;
+} LightEvent;
+typedef enum {
+    RESET_ONESHOT = 0,
+    RESET_STICKY = 1,
+    RESET_PULSE = 2,
+} ResetType;
+
+void LightLock_Init(LightLock* lock);
+void LightLock_Lock(LightLock* lock);
+int LightLock_TryLock(LightLock* lock);
+void LightLock_Unlock(LightLock* lock);
+void RecursiveLock_Init(RecursiveLock* lock);
+void RecursiveLock_Lock(RecursiveLock* lock);
+int RecursiveLock_TryLock(RecursiveLock* lock);
+void RecursiveLock_Unlock(RecursiveLock* lock);
+void LightEvent_Init(LightEvent* event, ResetType reset_type);
+void LightEvent_Clear(LightEvent* event);
+void LightEvent_Signal(LightEvent* event);
+int LightEvent_TryWait(LightEvent* event);
+void LightEvent_Wait(LightEvent* event);
+int LightEvent_WaitTimeout(LightEvent* event, s64 timeout_ns);
+
+#define AtomicIncrement(ptr) __atomic_add_fetch((u32*)(ptr), 1, __ATOMIC_SEQ_CST)
+#define AtomicDecrement(ptr) __atomic_sub_fetch((u32*)(ptr), 1, __ATOMIC_SEQ_CST)
+#define AtomicPostIncrement(ptr) __atomic_fetch_add((u32*)(ptr), 1, __ATOMIC_SEQ_CST)
+#define AtomicPostDecrement(ptr) __atomic_fetch_sub((u32*)(ptr), 1, __ATOMIC_SEQ_CST)
+
+// thread.h
+typedef struct Thread_tag* Thread;
+Thread threadCreate(ThreadFunc entrypoint, void* arg, size_t stack_size, int prio, int core_id, bool detached);
+Result threadJoin(Thread thread, u64 timeout_ns);
+void threadFree(Thread thread);
+
+// srv.h
+Result srvGetServiceHandle(Handle* out, const char* name);
+
+// os.h
+#define SYSTEM_VERSION(major, minor, revision) (((major)<<24)|((minor)<<16)|((revision)<<8))
+u32 osGetFirmVersion(void);
+u32 osGetKernelVersion(void);
+
+typedef struct {
+    u32 datetime_selector;
+    u8 running_hw;
+    u8 mcu_hwinfo;
+    u8 unk_x06[0x1A];
+    u8 wifi_macaddr[6];
+    u8 wifi_strength;
+    u8 network_state;
+    u8 unk_x28[0x18];
+} osSharedConfig_s;
+
+extern osSharedConfig_s* OS_SharedConfig_ptr;
+#define OS_SharedConfig OS_SharedConfig_ptr
+
+// fs.h
+enum {
+    FS_OPEN_READ   = BIT(0),
+    FS_OPEN_WRITE  = BIT(1),
+    FS_OPEN_CREATE = BIT(2),
+};
+enum {
+    FS_WRITE_FLUSH       = BIT(0),
+    FS_WRITE_UPDATE_TIME = BIT(8),
+};
+enum {
+    FS_ATTRIBUTE_DIRECTORY = BIT(0),
+    FS_ATTRIBUTE_HIDDEN    = BIT(8),
+    FS_ATTRIBUTE_ARCHIVE   = BIT(16),
+    FS_ATTRIBUTE_READ_ONLY = BIT(24),
+};
+typedef enum {
+    MEDIATYPE_NAND      = 0,
+    MEDIATYPE_SD        = 1,
+    MEDIATYPE_GAME_CARD = 2,
+} FS_MediaType;
+typedef enum {
+    ARCHIVE_ROMFS                    = 0x00000003,
+    ARCHIVE_SAVEDATA                 = 0x00000004,
+    ARCHIVE_EXTDATA                  = 0x00000006,
+    ARCHIVE_SHARED_EXTDATA           = 0x00000007,
+    ARCHIVE_SYSTEM_SAVEDATA          = 0x00000008,
+    ARCHIVE_SDMC                     = 0x00000009,
+    ARCHIVE_SDMC_WRITE_ONLY          = 0x0000000A,
+    ARCHIVE_BOSS_EXTDATA             = 0x12345678,
+    ARCHIVE_CARD_SPIFS               = 0x12345679,
+    ARCHIVE_EXTDATA_AND_BOSS_EXTDATA = 0x1234567B,
+    ARCHIVE_SYSTEM_SAVEDATA2         = 0x1234567C,
+    ARCHIVE_NAND_RW                  = 0x1234567D,
+    ARCHIVE_NAND_RO                  = 0x1234567E,
+    ARCHIVE_NAND_RO_WRITE_ACCESS     = 0x1234567F,
+    ARCHIVE_SAVEDATA_AND_CONTENT     = 0x2345678A,
+    ARCHIVE_SAVEDATA_AND_CONTENT2    = 0x2345678E,
+    ARCHIVE_NAND_CTR_FS              = 0x567890AB,
+    ARCHIVE_TWL_PHOTO                = 0x567890AC,
+    ARCHIVE_TWL_SOUND                = 0x567890AD,
+    ARCHIVE_NAND_TWL_FS              = 0x567890AE,
+    ARCHIVE_NAND_W_FS                = 0x567890AF,
+    ARCHIVE_GAMECARD_SAVEDATA        = 0x567890B1,
+    ARCHIVE_USER_SAVEDATA            = 0x567890B2,
+    ARCHIVE_DEMO_SAVEDATA            = 0x567890B4,
+} FS_ArchiveID;
+typedef enum {
+    PATH_INVALID = 0,
+    PATH_EMPTY   = 1,
+    PATH_BINARY  = 2,
+    PATH_ASCII   = 3,
+    PATH_UTF16   = 4,
+} FS_PathType;
+
+typedef struct {
+    u16 name[0x106];
+    char shortName[0x0A];
+    char shortExt[0x04];
+    u8 valid;
+    u8 reserved;
+    u32 attributes;
+    u64 fileSize;
+} FS_DirectoryEntry;
+
+typedef struct {
+    char productCode[0x10];
+    char companyCode[0x2];
+    u16 remasterVersion;
+} FS_ProductInfo;
+
+typedef struct {
+    FS_PathType type;
+    u32 size;
+    const void* data;
+} FS_Path;
+
+typedef u64 FS_Archive;
+
+FS_Path fsMakePath(FS_PathType type, const void* path);
+Result FSUSER_OpenArchive(FS_Archive* archive, FS_ArchiveID id, FS_Path path);
+Result FSUSER_CloseArchive(FS_Archive archive);
+Result FSUSER_OpenFile(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes);
+Result FSUSER_OpenFileDirectly(Handle* out, FS_ArchiveID archiveId, FS_Path archivePath, FS_Path filePath, u32 openFlags, u32 attributes);
+Result FSUSER_OpenDirectory(Handle* out, FS_Archive archive, FS_Path path);
+Result FSUSER_GetProductInfo(FS_ProductInfo* info, u32 processId);
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size);
+Result FSFILE_GetSize(Handle handle, u64* size);
+Result FSFILE_GetAttributes(Handle handle, u32* attributes);
+Result FSFILE_Close(Handle handle);
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags);
+Result FSFILE_SetSize(Handle handle, u64 size);
+Result FSUSER_CreateDirectory(FS_Archive archive, FS_Path path, u32 attributes);
+Result FSDIR_Read(Handle handle, u32* entriesRead, u32 entryCount, FS_DirectoryEntry* entries);
+Result FSDIR_Close(Handle handle);
+
+// fspxi.h
+typedef u64 FSPXI_Archive;
+typedef u64 FSPXI_File;
+
+Result FSPXI_OpenFile(Handle serviceHandle, FSPXI_File* out, FSPXI_Archive archive, FS_Path path, u32 flags, u32 attributes);
+Result FSPXI_OpenArchive(Handle serviceHandle, FSPXI_Archive* archive, FS_ArchiveID archiveID, FS_Path path);
+Result FSPXI_CloseArchive(Handle serviceHandle, FSPXI_Archive archive);
+Result FSPXI_ReadFile(Handle serviceHandle, FSPXI_File file, u32* bytesRead, u64 offset, void* buffer, u32 size);
+Result FSPXI_GetFileSize(Handle serviceHandle, FSPXI_File file, u64* size);
+Result FSPXI_CloseFile(Handle serviceHandle, FSPXI_File file);
+
+// am.h, cfgu.h
+Result amInit(void);
+void amExit(void);
+Result AM_GetDeviceId(u32* deviceID);
+Result cfguInit(void);
+void cfguExit(void);
+Result CFGU_GetConfigInfoBlk2(u32 size, u32 blkID, void* outData);
+
+// exheader.h (only what is referenced by the plugin)
+typedef struct {
+    u32 address;
+    u32 num_pages;
+    u32 size;
+} ExHeader_CodeSectionInfo;
+
+typedef struct {
+    char name[8];
+    u8 flags[6];
+    u16 remaster_version;
+    ExHeader_CodeSectionInfo text;
+    u32 stack_size;
+    ExHeader_CodeSectionInfo rodata;
+    u32 reserved;
+    ExHeader_CodeSectionInfo data;
+    u32 bss_size;
+} ExHeader_CodeSetInfo;
+
+typedef struct {
+    ExHeader_CodeSetInfo codeset_info;
+    u8 deps_and_system_info[0x200 - sizeof(ExHeader_CodeSetInfo)];
+} ExHeader_SystemControlInfo;
+
+typedef struct {
+    ExHeader_SystemControlInfo sci;
+    u8 aci[0x200];
+} ExHeader_Info;
+
+// soc.h, sockets themselves are the host's
+Result socInit(u32* context_addr, u32 context_size);
+Result socExit(void);
+
+// console.h, output goes to stdout
+typedef struct {
+    int cursorX;
+    int cursorY;
+    int fg;
+    int bg;
+} PrintConsole;
+
+PrintConsole* consoleSelect(PrintConsole* console);
+
+// gfx.h, framebuffers are plain memory that is never shown
+typedef enum {
+    GFX_TOP = 0,
+    GFX_BOTTOM = 1,
+} gfxScreen_t;
+
+typedef enum {
+    GFX_LEFT = 0,
+    GFX_RIGHT = 1,
+} gfx3dSide_t;
+
+u8* gfxGetFramebuffer(gfxScreen_t screen, gfx3dSide_t side, u16* width, u16* height);
+
+#ifdef __cplusplus
+}
+#endif
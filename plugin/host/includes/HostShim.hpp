@@ -0,0 +1,45 @@
+#pragma once
+#include "3ds.h"
+#include <string>
+
+// Configuration of the host libctru shim
+namespace HostShim {
+
+    // Title ID reported for the current process, System Settings (USA)
+    constexpr u64 PROCESS_TITLE_ID = 0x0004001000021000ULL;
+
+    // Directory backing the FS archives and the process data (code.bin, exheader.bin).
+    // Defaults to $ARTIC_HOST_ROOT, or "fsroot" if not set.
+    void SetRoot(const std::string& path);
+    const std::string& GetRoot();
+
+    // Reads a whole file from the root directory, returns false if missing
+    bool ReadRootFile(const char* name, std::string& out);
+
+    // Cost of the console storage added to the FS calls, so read-ahead and caching
+    // compare on the host like they do on the console. Calls to the same medium are
+    // served one at a time. Times are in microseconds.
+    struct StorageCost {
+        // Every FS call
+        u32 ipcUs;
+        u32 archiveOpenUs;
+        // File and directory opens
+        u32 openUs;
+        // Every 0x200 byte sector read or written
+        u32 sectorUs;
+        // 0 is unlimited
+        u32 throughputKBps;
+        // Every entry returned by FSDIR_Read
+        u32 dirEntryUs;
+    };
+
+    enum class Medium {
+        NAND,
+        SD,
+    };
+
+    // "none", "console" (the default, uncalibrated), optionally followed by overrides such as
+    // "console,sd.bw=8000,nand.ipc=100". Keys: ipc, archive, open, sector, bw, dir.
+    bool SetStorageCost(const std::string& spec);
+    const StorageCost& GetStorageCost(Medium medium);
+}
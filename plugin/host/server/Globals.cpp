@@ -0,0 +1,7 @@
+// Globals main.cpp defines on the console, shared by the host programs that link
+// the plugin sources.
+#include "Main.hpp"
+
+Logger logger;
+int transferedBytes = 0;
+PrintConsole topScreenConsole, bottomScreenConsole;
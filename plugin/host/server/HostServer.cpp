@@ -0,0 +1,163 @@
+// Host (Linux) entry point of the plugin server, replacing sources/main.cpp.
+// Runs the real ArticProtocolServer and handlers against the libctru shim.
+#include "Main.hpp"
+#include "HostShim.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ArticProtocolServer.hpp"
+#include "ArticFunctions.hpp"
+#include "Metrics.hpp"
+#include "BootProfile.hpp"
+
+static void Usage(const char* name) {
+    fprintf(stderr,
+        "Usage: %s [-r root] [-s storage] [-p port] [-m port] [-n connections] [-d]\n"
+        "  -r  Directory backing the FS archives (default $ARTIC_HOST_ROOT or fsroot)\n"
+        "  -s  Storage cost model: none, console (default, uncalibrated) and overrides, e.g. console,sd.bw=8000\n"
+        "  -p  Port to listen on (default %d)\n"
+        "  -m  Serve /metrics on this port, 0 to disable (default %d if metrics.enable exists)\n"
+        "  -n  Exit after serving this many connections (default 0, never)\n"
+        "  -d  Enable the debug log\n", name, SERVER_PORT, METRICS_PORT);
+}
+
+static int Listen(int port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        logger.Error("Server: Cannot create socket");
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in servaddr = {0};
+    servaddr.sin_family      = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    servaddr.sin_port        = htons(port);
+    if (bind(listen_fd, (struct sockaddr *) &servaddr, sizeof(servaddr)) < 0) {
+        logger.Error("Server: Failed to bind() to port %d", port);
+        close(listen_fd);
+        return -1;
+    }
+    if (listen(listen_fd, 1) < 0) {
+        logger.Error("Server: Failed to listen()");
+        close(listen_fd);
+        return -1;
+    }
+    logger.Info("Server: Listening on: 0.0.0.0:%d", port);
+    return listen_fd;
+}
+
+int main(int argc, char* argv[]) {
+    int port = SERVER_PORT;
+    // Like on the console unless given
+    int metricsPort = -1;
+    int connections = 0;
+    bool debug = false;
+    std::string storage = "console";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:s:p:m:n:dh")) != -1) {
+        switch (opt) {
+        case 'r': HostShim::SetRoot(optarg); break;
+        case 's':
+            if (!HostShim::SetStorageCost(optarg)) {
+                fprintf(stderr, "Invalid storage cost: %s\n", optarg);
+                return 1;
+            }
+            storage = optarg;
+            break;
+        case 'p': port = atoi(optarg); break;
+        case 'm': metricsPort = atoi(optarg); break;
+        case 'n': connections = atoi(optarg); break;
+        case 'd': debug = true; break;
+        default: Usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    // Disconnects are reported by send() instead
+    signal(SIGPIPE, SIG_IGN);
+
+    BootProfile::Start();
+    logger.Start();
+    logger.debug_enable = debug;
+    logger.Info("Server: Serving %s", HostShim::GetRoot().c_str());
+    // Only times relative to other runs mean something until the model is measured on a console
+    if (storage.compare(0, 7, "console") == 0)
+        logger.Warning("Server: FS costs are uncalibrated estimates (%s)", storage.c_str());
+
+    bool setupCorrect = true;
+    {
+        BootProfile::Phase phase("setupFunctions");
+        for (auto it = ArticFunctions::setupFunctions.begin(); it != ArticFunctions::setupFunctions.end(); it++) {
+            setupCorrect = (*it)() && setupCorrect;
+        }
+    }
+    if (!setupCorrect) {
+        logger.Error("Server: Setup failed");
+        logger.End();
+        return 1;
+    }
+    if (metricsPort < 0)
+        metricsPort = ArticFunctions::Metrics::IsEnabled() ? METRICS_PORT : 0;
+    {
+        BootProfile::Phase phase("metrics");
+        ArticFunctions::Metrics::StartServer(metricsPort);
+    }
+
+    int served = 0;
+    while (!connections || served < connections) {
+        int listen_fd = Listen(port);
+        if (listen_fd < 0)
+            break;
+        if (!served) {
+            BootProfile::Mark("listening");
+            BootProfile::Report("Boot");
+        }
+
+        struct sockaddr_in peeraddr = {0};
+        socklen_t peeraddr_len = sizeof(peeraddr);
+        int accept_fd;
+        do {
+            accept_fd = accept(listen_fd, (struct sockaddr *) &peeraddr, &peeraddr_len);
+        } while (accept_fd < 0 && errno == EINTR);
+        close(listen_fd);
+        if (accept_fd < 0) {
+            logger.Error("Server: Failed to accept()");
+            break;
+        }
+
+        logger.Info("Server: Connected: %s:%d", inet_ntoa(peeraddr.sin_addr), ntohs(peeraddr.sin_port));
+
+        if (!ArticProtocolServer::SetNonBlock(accept_fd, true)) {
+            logger.Error("Server: Failed to set non-block");
+            shutdown(accept_fd, SHUT_RDWR);
+            close(accept_fd);
+            continue;
+        }
+
+        ArticProtocolServer* articBase = new ArticProtocolServer(accept_fd);
+        articBase->Serve();
+        delete articBase;
+        logger.Info("Server: Disconnected");
+
+        for (auto it = ArticFunctions::destructFunctions.begin(); it != ArticFunctions::destructFunctions.end(); it++) {
+            (*it)();
+        }
+        served++;
+    }
+
+    ArticFunctions::Metrics::StopServer();
+    logger.End();
+    return 0;
+}
@@ -0,0 +1,528 @@
+// FS part of the libctru shim. Archives are directories under the root:
+//   <root>/<archive ID as %08x>[/<archive path>]/<file path>
+// ASCII and UTF-16 paths are used as they are, binary paths are hex encoded.
+// FSPXI archives and files are mapped the same way.
+// Every call is slowed down by the storage cost model of its medium, see HostShim.hpp.
+#include "3ds.h"
+#include "HostShim.hpp"
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using HostShim::Medium;
+using HostShim::StorageCost;
+using Clock = std::chrono::steady_clock;
+
+static const Result RES_NOT_FOUND = MAKERESULT(RL_STATUS, RS_NOTFOUND, RM_FS, 120);
+static const Result RES_ALREADY_EXISTS = MAKERESULT(RL_STATUS, RS_NOP, RM_FS, 190);
+static const Result RES_INVALID_PATH = MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_FS, 230);
+static const Result RES_INVALID_HANDLE = MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_FS, RD_INVALID_HANDLE);
+static const Result RES_HOST_ERROR = MAKERESULT(RL_PERMANENT, RS_INTERNAL, RM_FS, RD_NOT_IMPLEMENTED);
+
+// Closed once removed from the map and no call is using it anymore
+struct Object {
+    std::string path;
+    int fd = -1;
+    DIR* dir = nullptr;
+    Medium medium = Medium::NAND;
+    // The DIR stream can only be read by one call at a time
+    std::mutex dirMutex;
+
+    ~Object() {
+        if (fd >= 0)
+            close(fd);
+        if (dir)
+            closedir(dir);
+    }
+};
+using ObjectRef = std::shared_ptr<Object>;
+
+static std::map<u64, ObjectRef> objects;
+static u64 nextID = 0x100;
+static std::mutex objectsMutex;
+
+static constexpr u32 SECTOR_SIZE = 0x200;
+
+// Uncalibrated estimates of the 3DS FS timings, none of them has been measured on a
+// console yet. Replace them with on-console measurements and update README.md.
+static const StorageCost CONSOLE_NAND = {60, 1500, 700, 2, 9000, 40};
+static const StorageCost CONSOLE_SD = {60, 600, 2500, 3, 6000, 120};
+
+static StorageCost costs[2] = {CONSOLE_NAND, CONSOLE_SD};
+static Clock::time_point busyUntil[2];
+static std::mutex costMutex;
+
+static Medium ArchiveMedium(FS_ArchiveID id) {
+    switch (id) {
+    case ARCHIVE_ROMFS:
+    case ARCHIVE_SAVEDATA:
+    case ARCHIVE_EXTDATA:
+    case ARCHIVE_SDMC:
+    case ARCHIVE_SDMC_WRITE_ONLY:
+    case ARCHIVE_BOSS_EXTDATA:
+    case ARCHIVE_EXTDATA_AND_BOSS_EXTDATA:
+        return Medium::SD;
+    default:
+        return Medium::NAND;
+    }
+}
+
+// Blocks for the IPC overhead plus extraUs, after the previous calls to the medium
+static void Charge(Medium medium, u64 extraUs = 0) {
+    Clock::time_point done;
+    {
+        std::lock_guard<std::mutex> l(costMutex);
+        const StorageCost& cost = costs[(int)medium];
+        u64 us = cost.ipcUs + extraUs;
+        if (!us)
+            return;
+        Clock::time_point& busy = busyUntil[(int)medium];
+        done = std::max(Clock::now(), busy) + std::chrono::microseconds(us);
+        busy = done;
+    }
+    std::this_thread::sleep_until(done);
+}
+
+static u64 TransferCost(Medium medium, u64 offset, u32 size) {
+    const StorageCost& cost = costs[(int)medium];
+    if (!size)
+        return 0;
+    u64 sectors = (offset + size + SECTOR_SIZE - 1) / SECTOR_SIZE - offset / SECTOR_SIZE;
+    u64 us = sectors * cost.sectorUs;
+    if (cost.throughputKBps)
+        us += (u64)size * 1000 / cost.throughputKBps;
+    return us;
+}
+
+static Result ErrnoToResult() {
+    switch (errno) {
+    case ENOENT:
+    case ENOTDIR:
+        return RES_NOT_FOUND;
+    case EEXIST:
+        return RES_ALREADY_EXISTS;
+    default:
+        return RES_HOST_ERROR;
+    }
+}
+
+static u64 AddObject(ObjectRef object) {
+    std::lock_guard<std::mutex> l(objectsMutex);
+    u64 id = nextID++;
+    objects[id] = std::move(object);
+    return id;
+}
+
+static ObjectRef GetObject(u64 id) {
+    std::lock_guard<std::mutex> l(objectsMutex);
+    auto it = objects.find(id);
+    if (it == objects.end())
+        return nullptr;
+    return it->second;
+}
+
+static Result RemoveObject(u64 id) {
+    ObjectRef object;
+    {
+        std::lock_guard<std::mutex> l(objectsMutex);
+        auto it = objects.find(id);
+        if (it == objects.end())
+            return RES_INVALID_HANDLE;
+        object = std::move(it->second);
+        objects.erase(it);
+    }
+    Charge(object->medium);
+    return 0;
+}
+
+// Converts a FS path to a relative host path, rejecting anything leaving the archive
+static bool PathToHost(const FS_Path& path, std::string& out) {
+    out.clear();
+    const u8* data = (const u8*)path.data;
+    switch (path.type) {
+    case PATH_EMPTY:
+        return true;
+    case PATH_ASCII:
+        for (u32 i = 0; i < path.size && data[i]; i++)
+            out += (char)data[i];
+        break;
+    case PATH_UTF16:
+        for (u32 i = 0; i + 1 < path.size; i += 2) {
+            u16 c = data[i] | (data[i + 1] << 8);
+            if (!c)
+                break;
+            out += c < 0x80 ? (char)c : '_';
+        }
+        break;
+    case PATH_BINARY: {
+        static const char hex[] = "0123456789abcdef";
+        for (u32 i = 0; i < path.size; i++) {
+            out += hex[data[i] >> 4];
+            out += hex[data[i] & 0xF];
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+
+    while (!out.empty() && out[0] == '/')
+        out.erase(0, 1);
+    size_t start = 0;
+    while (start <= out.size()) {
+        size_t end = out.find('/', start);
+        if (end == std::string::npos)
+            end = out.size();
+        if (out.compare(start, end - start, "..") == 0)
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+static Result ArchiveDirectory(FS_ArchiveID id, const FS_Path& archivePath, std::string& out) {
+    std::string sub;
+    if (!PathToHost(archivePath, sub))
+        return RES_INVALID_PATH;
+    char name[9];
+    snprintf(name, sizeof(name), "%08x", (u32)id);
+    out = HostShim::GetRoot() + "/" + name;
+    if (!sub.empty())
+        out += "/" + sub;
+    return 0;
+}
+
+static Result Resolve(u64 archive, const FS_Path& path, std::string& out, Medium& medium) {
+    ObjectRef object = GetObject(archive);
+    std::string sub;
+    if (!object || object->fd >= 0 || object->dir)
+        return RES_INVALID_HANDLE;
+    medium = object->medium;
+    if (!PathToHost(path, sub))
+        return RES_INVALID_PATH;
+    out = object->path + "/" + sub;
+    return 0;
+}
+
+static Result OpenArchive(u64* out, FS_ArchiveID id, const FS_Path& path) {
+    ObjectRef object = std::make_shared<Object>();
+    object->medium = ArchiveMedium(id);
+    Charge(object->medium, costs[(int)object->medium].archiveOpenUs);
+    Result res = ArchiveDirectory(id, path, object->path);
+    if (R_FAILED(res))
+        return res;
+    struct stat st;
+    if (stat(object->path.c_str(), &st) || !S_ISDIR(st.st_mode))
+        return RES_NOT_FOUND;
+    *out = AddObject(object);
+    return 0;
+}
+
+static Result OpenFile(u64* out, const std::string& path, u32 openFlags, Medium medium) {
+    Charge(medium, costs[(int)medium].openUs);
+    int flags = (openFlags & FS_OPEN_WRITE) ? O_RDWR : O_RDONLY;
+    if (openFlags & FS_OPEN_CREATE)
+        flags |= O_CREAT;
+    int fd = open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return ErrnoToResult();
+    struct stat st;
+    if (fstat(fd, &st) || S_ISDIR(st.st_mode)) {
+        close(fd);
+        return RES_NOT_FOUND;
+    }
+    ObjectRef object = std::make_shared<Object>();
+    object->path = path;
+    object->fd = fd;
+    object->medium = medium;
+    *out = AddObject(object);
+    return 0;
+}
+
+static Result ReadFile(u64 file, u32* bytesRead, u64 offset, void* buffer, u32 size) {
+    ObjectRef object = GetObject(file);
+    if (!object || object->fd < 0)
+        return RES_INVALID_HANDLE;
+    Charge(object->medium, TransferCost(object->medium, offset, size));
+    u32 done = 0;
+    while (done < size) {
+        ssize_t got = pread(object->fd, (u8*)buffer + done, size - done, offset + done);
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            return ErrnoToResult();
+        }
+        if (got == 0)
+            break;
+        done += got;
+    }
+    *bytesRead = done;
+    return 0;
+}
+
+static Result GetFileSize(u64 file, u64* size) {
+    ObjectRef object = GetObject(file);
+    struct stat st;
+    if (!object || object->fd < 0)
+        return RES_INVALID_HANDLE;
+    Charge(object->medium);
+    if (fstat(object->fd, &st))
+        return ErrnoToResult();
+    *size = st.st_size;
+    return 0;
+}
+
+namespace HostShim {
+
+    bool SetStorageCost(const std::string& spec) {
+        StorageCost parsed[2] = {CONSOLE_NAND, CONSOLE_SD};
+        size_t start = 0;
+        while (start <= spec.size()) {
+            size_t end = spec.find(',', start);
+            if (end == std::string::npos)
+                end = spec.size();
+            std::string item = spec.substr(start, end - start);
+            start = end + 1;
+
+            if (item == "none") {
+                parsed[0] = parsed[1] = StorageCost{};
+                continue;
+            }
+            if (item == "console") {
+                parsed[0] = CONSOLE_NAND;
+                parsed[1] = CONSOLE_SD;
+                continue;
+            }
+
+            size_t dot = item.find('.'), eq = item.find('=');
+            if (dot == std::string::npos || eq == std::string::npos || eq < dot)
+                return false;
+            std::string medium = item.substr(0, dot), key = item.substr(dot + 1, eq - dot - 1);
+            char* valueEnd;
+            unsigned long value = strtoul(item.c_str() + eq + 1, &valueEnd, 0);
+            if (*valueEnd || (medium != "nand" && medium != "sd"))
+                return false;
+
+            StorageCost& cost = parsed[medium == "sd" ? (int)Medium::SD : (int)Medium::NAND];
+            if (key == "ipc") cost.ipcUs = value;
+            else if (key == "archive") cost.archiveOpenUs = value;
+            else if (key == "open") cost.openUs = value;
+            else if (key == "sector") cost.sectorUs = value;
+            else if (key == "bw") cost.throughputKBps = value;
+            else if (key == "dir") cost.dirEntryUs = value;
+            else return false;
+        }
+
+        std::lock_guard<std::mutex> l(costMutex);
+        costs[0] = parsed[0];
+        costs[1] = parsed[1];
+        return true;
+    }
+
+    const StorageCost& GetStorageCost(Medium medium) {
+        return costs[(int)medium];
+    }
+}
+
+extern "C" {
+
+FS_Path fsMakePath(FS_PathType type, const void* path) {
+    FS_Path p = {type, 0, path};
+    switch (type) {
+    case PATH_ASCII:
+        p.size = strlen((const char*)path) + 1;
+        break;
+    case PATH_UTF16: {
+        const u16* str = (const u16*)path;
+        while (str[p.size / 2])
+            p.size += 2;
+        p.size += 2;
+        break;
+    }
+    case PATH_EMPTY:
+        p.size = 1;
+        p.data = "";
+        break;
+    default:
+        break;
+    }
+    return p;
+}
+
+Result FSUSER_OpenArchive(FS_Archive* archive, FS_ArchiveID id, FS_Path path) {
+    return OpenArchive(archive, id, path);
+}
+
+Result FSUSER_CloseArchive(FS_Archive archive) {
+    return RemoveObject(archive);
+}
+
+Result FSUSER_OpenFile(Handle* out, FS_Archive archive, FS_Path path, u32 openFlags, u32 attributes) {
+    std::string host;
+    Medium medium;
+    u64 id;
+    Result res = Resolve(archive, path, host, medium);
+    if (R_SUCCEEDED(res)) res = OpenFile(&id, host, openFlags, medium);
+    if (R_SUCCEEDED(res)) *out = (Handle)id;
+    return res;
+}
+
+Result FSUSER_OpenFileDirectly(Handle* out, FS_ArchiveID archiveId, FS_Path archivePath, FS_Path filePath, u32 openFlags, u32 attributes) {
+    std::string dir, sub;
+    u64 id;
+    Result res = ArchiveDirectory(archiveId, archivePath, dir);
+    if (R_SUCCEEDED(res) && !PathToHost(filePath, sub)) res = RES_INVALID_PATH;
+    if (R_SUCCEEDED(res)) res = OpenFile(&id, dir + "/" + sub, openFlags, ArchiveMedium(archiveId));
+    if (R_SUCCEEDED(res)) *out = (Handle)id;
+    return res;
+}
+
+Result FSUSER_OpenDirectory(Handle* out, FS_Archive archive, FS_Path path) {
+    ObjectRef object = std::make_shared<Object>();
+    Result res = Resolve(archive, path, object->path, object->medium);
+    if (R_FAILED(res))
+        return res;
+    Charge(object->medium, costs[(int)object->medium].openUs);
+    object->dir = opendir(object->path.c_str());
+    if (!object->dir)
+        return ErrnoToResult();
+    *out = (Handle)AddObject(object);
+    return 0;
+}
+
+Result FSUSER_CreateDirectory(FS_Archive archive, FS_Path path, u32 attributes) {
+    std::string host;
+    Medium medium;
+    Result res = Resolve(archive, path, host, medium);
+    if (R_SUCCEEDED(res)) Charge(medium, costs[(int)medium].openUs);
+    if (R_SUCCEEDED(res) && mkdir(host.c_str(), 0755)) res = ErrnoToResult();
+    return res;
+}
+
+Result FSUSER_GetProductInfo(FS_ProductInfo* info, u32 processId) {
+    memset(info, 0, sizeof(FS_ProductInfo));
+    memcpy(info->productCode, "CTR-N-HOST", 10);
+    memcpy(info->companyCode, "00", 2);
+    return 0;
+}
+
+Result FSFILE_Read(Handle handle, u32* bytesRead, u64 offset, void* buffer, u32 size) {
+    return ReadFile(handle, bytesRead, offset, buffer, size);
+}
+
+Result FSFILE_Write(Handle handle, u32* bytesWritten, u64 offset, const void* buffer, u32 size, u32 flags) {
+    ObjectRef object = GetObject(handle);
+    if (!object || object->fd < 0)
+        return RES_INVALID_HANDLE;
+    Charge(object->medium, TransferCost(object->medium, offset, size));
+    ssize_t written = pwrite(object->fd, buffer, size, offset);
+    if (written < 0)
+        return ErrnoToResult();
+    if (flags & FS_WRITE_FLUSH)
+        fsync(object->fd);
+    *bytesWritten = (u32)written;
+    return 0;
+}
+
+Result FSFILE_SetSize(Handle handle, u64 size) {
+    ObjectRef object = GetObject(handle);
+    if (!object || object->fd < 0)
+        return RES_INVALID_HANDLE;
+    Charge(object->medium);
+    return ftruncate(object->fd, size) ? ErrnoToResult() : 0;
+}
+
+Result FSFILE_GetSize(Handle handle, u64* size) {
+    return GetFileSize(handle, size);
+}
+
+Result FSFILE_GetAttributes(Handle handle, u32* attributes) {
+    ObjectRef object = GetObject(handle);
+    if (!object || object->fd < 0)
+        return RES_INVALID_HANDLE;
+    Charge(object->medium);
+    *attributes = access(object->path.c_str(), W_OK) ? FS_ATTRIBUTE_READ_ONLY : 0;
+    return 0;
+}
+
+Result FSFILE_Close(Handle handle) {
+    return RemoveObject(handle);
+}
+
+Result FSDIR_Read(Handle handle, u32* entriesRead, u32 entryCount, FS_DirectoryEntry* entries) {
+    // Keeps the DIR stream open even if the directory is closed meanwhile
+    ObjectRef object = GetObject(handle);
+    if (!object || !object->dir)
+        return RES_INVALID_HANDLE;
+
+    std::unique_lock<std::mutex> l(object->dirMutex);
+    u32 count = 0;
+    while (count < entryCount) {
+        dirent* ent = readdir(object->dir);
+        if (!ent)
+            break;
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+
+        struct stat st;
+        if (fstatat(dirfd(object->dir), ent->d_name, &st, 0))
+            continue;
+
+        FS_DirectoryEntry& entry = entries[count++];
+        memset(&entry, 0, sizeof(entry));
+        for (size_t i = 0; ent->d_name[i] && i < 0x105; i++)
+            entry.name[i] = (u8)ent->d_name[i];
+        entry.valid = 1;
+        entry.attributes = S_ISDIR(st.st_mode) ? FS_ATTRIBUTE_DIRECTORY : 0;
+        if (ent->d_name[0] == '.')
+            entry.attributes |= FS_ATTRIBUTE_HIDDEN;
+        entry.fileSize = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+    }
+    l.unlock();
+    Charge(object->medium, (u64)count * costs[(int)object->medium].dirEntryUs);
+    *entriesRead = count;
+    return 0;
+}
+
+Result FSDIR_Close(Handle handle) {
+    return RemoveObject(handle);
+}
+
+Result FSPXI_OpenArchive(Handle serviceHandle, FSPXI_Archive* archive, FS_ArchiveID archiveID, FS_Path path) {
+    return OpenArchive(archive, archiveID, path);
+}
+
+Result FSPXI_CloseArchive(Handle serviceHandle, FSPXI_Archive archive) {
+    return RemoveObject(archive);
+}
+
+Result FSPXI_OpenFile(Handle serviceHandle, FSPXI_File* out, FSPXI_Archive archive, FS_Path path, u32 flags, u32 attributes) {
+    std::string host;
+    Medium medium;
+    Result res = Resolve(archive, path, host, medium);
+    if (R_SUCCEEDED(res)) res = OpenFile(out, host, flags, medium);
+    return res;
+}
+
+Result FSPXI_ReadFile(Handle serviceHandle, FSPXI_File file, u32* bytesRead, u64 offset, void* buffer, u32 size) {
+    return ReadFile(file, bytesRead, offset, buffer, size);
+}
+
+Result FSPXI_GetFileSize(Handle serviceHandle, FSPXI_File file, u64* size) {
+    return GetFileSize(file, size);
+}
+
+Result FSPXI_CloseFile(Handle serviceHandle, FSPXI_File file) {
+    return RemoveObject(file);
+}
+
+}
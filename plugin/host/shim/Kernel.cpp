@@ -0,0 +1,367 @@
+// Kernel, threading and synchronization parts of the libctru shim
+#include "3ds.h"
+#include "HostShim.hpp"
+
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+
+extern "C" {
+#include "csvc.h"
+}
+
+static constexpr u64 SYSCLOCK_ARM11 = 268111856;
+// Host code needs more stack than the 3DS threads are created with
+static constexpr size_t MIN_STACK_SIZE = 0x40000;
+
+static const Result RES_NOT_IMPLEMENTED = MAKERESULT(RL_PERMANENT, RS_NOTSUPPORTED, RM_KERNEL, RD_NOT_IMPLEMENTED);
+static const Result RES_TIMEOUT = MAKERESULT(RL_INFO, RS_NOP, RM_KERNEL, RD_TIMEOUT);
+
+namespace HostShim {
+
+    static std::string root;
+    static std::mutex rootMutex;
+
+    void SetRoot(const std::string& path) {
+        std::lock_guard<std::mutex> l(rootMutex);
+        root = path;
+    }
+
+    const std::string& GetRoot() {
+        std::lock_guard<std::mutex> l(rootMutex);
+        if (root.empty()) {
+            const char* env = getenv("ARTIC_HOST_ROOT");
+            root = env && env[0] ? env : "fsroot";
+        }
+        return root;
+    }
+
+    bool ReadRootFile(const char* name, std::string& out) {
+        std::ifstream file(GetRoot() + "/" + name, std::ios::binary);
+        if (!file)
+            return false;
+        std::stringstream ss;
+        ss << file.rdbuf();
+        out = ss.str();
+        return true;
+    }
+}
+
+static s64 MonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static long Futex(s32* addr, int op, s32 value, const timespec* timeout) {
+    return syscall(SYS_futex, addr, op, value, timeout, nullptr, 0);
+}
+
+extern "C" {
+
+// svc
+u64 svcGetSystemTick(void) {
+    return (u64)((unsigned __int128)MonotonicNs() * SYSCLOCK_ARM11 / 1000000000);
+}
+
+void svcSleepThread(s64 ns) {
+    if (ns <= 0) {
+        sched_yield();
+        return;
+    }
+    timespec ts = {(time_t)(ns / 1000000000), (long)(ns % 1000000000)};
+    while (nanosleep(&ts, &ts) && errno == EINTR);
+}
+
+Result svcCloseHandle(Handle handle) {
+    return 0;
+}
+
+Result svcSendSyncRequest(Handle session) {
+    return RES_NOT_IMPLEMENTED;
+}
+
+Result svcGetProcessId(u32* out, Handle handle) {
+    *out = (u32)getpid();
+    return 0;
+}
+
+Result svcGetThreadPriority(s32* out, Handle handle) {
+    *out = 0x30;
+    return 0;
+}
+
+Result svcGetThreadId(u32* out, Handle handle) {
+    *out = (u32)syscall(SYS_gettid);
+    return 0;
+}
+
+Result svcGetSystemInfo(s64* out, u32 type, s32 param) {
+    return RES_NOT_IMPLEMENTED;
+}
+
+// The code region is the contents of <root>/code.bin, reported as a single text segment
+Result svcGetProcessInfo(s64* out, Handle process, u32 type) {
+    static std::string code;
+    static std::once_flag codeLoaded;
+    std::call_once(codeLoaded, [] { HostShim::ReadRootFile("code.bin", code); });
+
+    switch (type) {
+    case 0x10001:
+        *out = (s64)HostShim::PROCESS_TITLE_ID;
+        return 0;
+    case 0x10002:
+        *out = (s64)code.size();
+        return 0;
+    case 0x10003:
+    case 0x10004:
+        *out = 0;
+        return 0;
+    case 0x10005:
+        *out = (s64)(uintptr_t)code.data();
+        return 0;
+    default:
+        return RES_NOT_IMPLEMENTED;
+    }
+}
+
+Result svcControlService(ServiceOp op, ...) {
+    if (op != SERVICEOP_STEAL_CLIENT_SESSION)
+        return RES_NOT_IMPLEMENTED;
+    va_list args;
+    va_start(args, op);
+    Handle* out = va_arg(args, Handle*);
+    va_end(args);
+    *out = 0xFFFF0001;
+    return 0;
+}
+
+// synchronization, LightLock and LightEvent are futex based like on the 3DS
+void LightLock_Init(LightLock* lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+int LightLock_TryLock(LightLock* lock) {
+    s32 expected = 0;
+    return __atomic_compare_exchange_n(lock, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ? 0 : 1;
+}
+
+void LightLock_Lock(LightLock* lock) {
+    // 0 unlocked, 1 locked, 2 locked with waiters
+    s32 state = 0;
+    if (__atomic_compare_exchange_n(lock, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    if (state != 2)
+        state = __atomic_exchange_n(lock, 2, __ATOMIC_ACQUIRE);
+    while (state != 0) {
+        Futex(lock, FUTEX_WAIT_PRIVATE, 2, nullptr);
+        state = __atomic_exchange_n(lock, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void LightLock_Unlock(LightLock* lock) {
+    if (__atomic_exchange_n(lock, 0, __ATOMIC_RELEASE) == 2)
+        Futex(lock, FUTEX_WAKE_PRIVATE, 1, nullptr);
+}
+
+static u32 CurrentThreadTag() {
+    static u32 nextTag = 0;
+    static __thread u32 tag = 0;
+    if (!tag)
+        tag = __atomic_add_fetch(&nextTag, 1, __ATOMIC_RELAXED);
+    return tag;
+}
+
+void RecursiveLock_Init(RecursiveLock* lock) {
+    LightLock_Init(&lock->lock);
+    lock->thread_tag = 0;
+    lock->counter = 0;
+}
+
+void RecursiveLock_Lock(RecursiveLock* lock) {
+    u32 tag = CurrentThreadTag();
+    if (__atomic_load_n(&lock->thread_tag, __ATOMIC_RELAXED) != tag) {
+        LightLock_Lock(&lock->lock);
+        lock->thread_tag = tag;
+    }
+    lock->counter++;
+}
+
+int RecursiveLock_TryLock(RecursiveLock* lock) {
+    u32 tag = CurrentThreadTag();
+    if (__atomic_load_n(&lock->thread_tag, __ATOMIC_RELAXED) != tag) {
+        if (LightLock_TryLock(&lock->lock))
+            return 1;
+        lock->thread_tag = tag;
+    }
+    lock->counter++;
+    return 0;
+}
+
+void RecursiveLock_Unlock(RecursiveLock* lock) {
+    if (!--lock->counter) {
+        __atomic_store_n(&lock->thread_tag, 0, __ATOMIC_RELAXED);
+        LightLock_Unlock(&lock->lock);
+    }
+}
+
+// state: 1 signaled, 0 cleared. lock holds the reset type.
+void LightEvent_Init(LightEvent* event, ResetType reset_type) {
+    event->state = 0;
+    event->lock = reset_type;
+}
+
+void LightEvent_Clear(LightEvent* event) {
+    __atomic_store_n(&event->state, 0, __ATOMIC_RELEASE);
+}
+
+void LightEvent_Signal(LightEvent* event) {
+    if (event->lock == RESET_PULSE) {
+        Futex(&event->state, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+        return;
+    }
+    __atomic_store_n(&event->state, 1, __ATOMIC_RELEASE);
+    Futex(&event->state, FUTEX_WAKE_PRIVATE, event->lock == RESET_ONESHOT ? 1 : INT_MAX, nullptr);
+}
+
+int LightEvent_TryWait(LightEvent* event) {
+    if (event->lock == RESET_ONESHOT) {
+        s32 expected = 1;
+        return __atomic_compare_exchange_n(&event->state, &expected, 0, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+    return __atomic_load_n(&event->state, __ATOMIC_ACQUIRE) == 1;
+}
+
+int LightEvent_WaitTimeout(LightEvent* event, s64 timeout_ns) {
+    s64 deadline = timeout_ns < 0 ? -1 : MonotonicNs() + timeout_ns;
+    bool pulse = event->lock == RESET_PULSE;
+    while (pulse || !LightEvent_TryWait(event)) {
+        timespec ts, *tsp = nullptr;
+        if (deadline >= 0) {
+            s64 left = deadline - MonotonicNs();
+            if (left <= 0)
+                return RES_TIMEOUT;
+            ts = {(time_t)(left / 1000000000), (long)(left % 1000000000)};
+            tsp = &ts;
+        }
+        long res = Futex(&event->state, FUTEX_WAIT_PRIVATE, 0, tsp);
+        if (pulse && res == 0)
+            break;
+    }
+    return 0;
+}
+
+void LightEvent_Wait(LightEvent* event) {
+    LightEvent_WaitTimeout(event, -1);
+}
+
+// thread, priorities and cores are ignored
+struct Thread_tag {
+    pthread_t thread;
+    ThreadFunc entrypoint;
+    void* arg;
+    bool detached;
+    bool finished;
+};
+
+static void* ThreadEntry(void* param) {
+    Thread t = (Thread)param;
+    t->entrypoint(t->arg);
+    if (t->detached)
+        delete t;
+    else
+        __atomic_store_n(&t->finished, true, __ATOMIC_RELEASE);
+    return nullptr;
+}
+
+Thread threadCreate(ThreadFunc entrypoint, void* arg, size_t stack_size, int prio, int core_id, bool detached) {
+    Thread t = new Thread_tag{{}, entrypoint, arg, detached, false};
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, std::max(stack_size, MIN_STACK_SIZE));
+    if (detached)
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&t->thread, &attr, ThreadEntry, t);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        delete t;
+        return nullptr;
+    }
+    return t;
+}
+
+Result threadJoin(Thread thread, u64 timeout_ns) {
+    if (!thread)
+        return 0;
+    if (timeout_ns != U64_MAX) {
+        s64 deadline = MonotonicNs() + (s64)std::min<u64>(timeout_ns, INT64_MAX / 2);
+        while (!__atomic_load_n(&thread->finished, __ATOMIC_ACQUIRE)) {
+            if (MonotonicNs() >= deadline)
+                return RES_TIMEOUT;
+            svcSleepThread(1000000);
+        }
+    }
+    pthread_join(thread->thread, nullptr);
+    thread->detached = true;
+    return 0;
+}
+
+void threadFree(Thread thread) {
+    if (thread && thread->detached)
+        delete thread;
+}
+
+// srv, os, soc and console
+Result srvGetServiceHandle(Handle* out, const char* name) {
+    *out = 0xFFFF0002;
+    return 0;
+}
+
+u32 osGetFirmVersion(void) {
+    return SYSTEM_VERSION(2, 58, 0);
+}
+
+u32 osGetKernelVersion(void) {
+    return SYSTEM_VERSION(2, 58, 0);
+}
+
+static osSharedConfig_s sharedConfig = {0, 1, 0, {}, {0x40, 0xF4, 0x07, 0x00, 0x00, 0x01}, 3, 7, {}};
+osSharedConfig_s* OS_SharedConfig_ptr = &sharedConfig;
+
+Result socInit(u32* context_addr, u32 context_size) {
+    return 0;
+}
+
+Result socExit(void) {
+    return 0;
+}
+
+PrintConsole* consoleSelect(PrintConsole* console) {
+    static PrintConsole* current = nullptr;
+    PrintConsole* previous = current;
+    current = console;
+    return previous;
+}
+
+u8* gfxGetFramebuffer(gfxScreen_t screen, gfx3dSide_t side, u16* width, u16* height) {
+    // Rotated RGB565 like the console's default format
+    static u8 top[400 * 240 * 2], bottom[320 * 240 * 2];
+    if (width)
+        *width = 240;
+    if (height)
+        *height = screen == GFX_TOP ? 400 : 320;
+    return screen == GFX_TOP ? top : bottom;
+}
+
+}
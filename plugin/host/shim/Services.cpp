@@ -0,0 +1,59 @@
+// AM, CFG and Loader parts of the libctru shim. Console specific values are fixed,
+// the exheader of the last application is read from <root>/exheader.bin.
+#include "3ds.h"
+#include "HostShim.hpp"
+
+#include <string>
+#include <algorithm>
+
+static constexpr u32 DEVICE_ID = 0x13572468;
+static constexpr u64 CONSOLE_ID = 0x0123456789ABCDEFULL;
+static constexpr u32 CONSOLE_ID_RANDOM = 0x2468ACE0;
+
+extern "C" {
+
+Result amInit(void) {
+    return 0;
+}
+
+void amExit(void) {}
+
+Result AM_GetDeviceId(u32* deviceID) {
+    *deviceID = DEVICE_ID;
+    return 0;
+}
+
+Result cfguInit(void) {
+    return 0;
+}
+
+void cfguExit(void) {}
+
+Result CFGU_GetConfigInfoBlk2(u32 size, u32 blkID, void* outData) {
+    memset(outData, 0, size);
+    if (blkID == 0x00090001)
+        memcpy(outData, &CONSOLE_ID, std::min<u32>(size, sizeof(CONSOLE_ID)));
+    else if (blkID == 0x00090002)
+        memcpy(outData, &CONSOLE_ID_RANDOM, std::min<u32>(size, sizeof(CONSOLE_ID_RANDOM)));
+    return 0;
+}
+
+}
+
+// Replaces sources/loaderCustom.cpp, which passes buffers to the kernel as 32 bit addresses
+namespace ArticFunctions {
+
+    Result loaderInitCustom(void) {
+        return 0;
+    }
+
+    void loaderExitCustom(void) {}
+
+    Result LOADER_GetLastApplicationProgramInfo(ExHeader_Info* exheaderInfo) {
+        std::string exheader;
+        if (!HostShim::ReadRootFile("exheader.bin", exheader) || exheader.size() < sizeof(ExHeader_Info))
+            return MAKERESULT(RL_PERMANENT, RS_NOTFOUND, RM_APPLICATION, RD_NOT_FOUND);
+        memcpy(exheaderInfo, exheader.data(), sizeof(ExHeader_Info));
+        return 0;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "3ds.h"
+
+namespace ArticFunctions {
+
+    // Keeps derived, immutable blobs (decompressed NIM code, ExeFS sections) across
+    // connections, so that repeated setup attempts don't redo the NAND reads.
+    // Entries are evicted least recently used first when the cache is over budget
+    // or when a big allocation (result buffers, scratch) doesn't fit in the heap.
+    namespace ArtifactCache {
+        enum class Artifact : u8 {
+            NIM_CODE,
+            EXEFS_ICON,
+            EXEFS_BANNER,
+            EXEFS_LOGO,
+
+            COUNT,
+        };
+
+        // Half of the plugin heap, the rest is left for the request buffers
+        constexpr size_t MAX_CACHE_SIZE = 0x100000;
+
+        // Since the plugin started, a lookup is a Pin call
+        struct Stats {
+            u32 hits;
+            u32 misses;
+            size_t size;
+        };
+
+        // Returns the cached artifact and its size, or nullptr if it's not cached.
+        // The data stays valid and is never evicted until Unpin is called, so the
+        // caller can allocate its result buffer before copying it.
+        const void* Pin(Artifact artifact, size_t& size);
+        void Unpin(Artifact artifact);
+        // Does nothing if the artifact is pinned
+        void Store(Artifact artifact, const void* data, size_t size);
+        // Frees unpinned artifacts until at least the specified amount of bytes is
+        // released, returns the amount of bytes actually released
+        size_t Evict(size_t bytes);
+        void Clear();
+
+        Stats GetStats();
+    }
+}
@@ -41,7 +41,7 @@ namespace CTRPluginFramework {
             u32 dataLength;
         };
 
-        BCLIM(void* bclimData, u32 bclimSize) : BCLIM(bclimData, (Header*)((u32)bclimData + bclimSize - 0x28)) {}
+        BCLIM(void* bclimData, u32 bclimSize) : BCLIM(bclimData, (Header*)((uintptr_t)bclimData + bclimSize - 0x28)) {}
         BCLIM(void* bclimData, Header* bclimHeader) : data(bclimData), header(bclimHeader) {}
 
         using ColorBlendCallback = Color(*)(const Color &, const Color &);
@@ -64,7 +64,7 @@ namespace CTRPluginFramework {
 
         template<typename T>
         inline T GetDataAt(int offset) {
-            return *(T*)(((u32)data) + offset);
+            return *(T*)(((uintptr_t)data) + offset);
         }
 
         static void RenderInterfaceBackend(void* usrData, bool isRead, Color* c, int posX, int posY);
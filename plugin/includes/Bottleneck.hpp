@@ -0,0 +1,71 @@
+#pragma once
+#include "3ds.h"
+
+// Evaluates an FS call inside a Bottleneck::FSScope
+#define FS_TIMED(call) ([&]() { ArticFunctions::Bottleneck::FSScope fsScope; return call; }())
+
+namespace ArticFunctions {
+
+    // Splits the time of a session into the phases of its requests, to tell whether
+    // it is limited by FS, by the network or by the plugin's own processing. The
+    // server handles one request at a time, so the time between two requests is
+    // spent sending the previous result and waiting for the client.
+    namespace Bottleneck {
+
+        enum Phase : u8 {
+            PHASE_FS = 0, // FS IPC done by the handler
+            PHASE_PREP = 1, // Everything else in the handler: parameters, result buffers, copies, decompression
+            PHASE_SEND = 2, // Sending the result, the SOC layer and the client round trip
+
+            PHASE_COUNT,
+        };
+
+        enum Verdict : u8 {
+            VERDICT_NONE = 0, // Nothing measured yet
+            VERDICT_FS = 1,
+            VERDICT_NETWORK = 2,
+            VERDICT_CPU = 3,
+        };
+
+        // Returned as is by System_GetBottleneck
+        struct Summary {
+            u64 phaseUs[PHASE_COUNT];
+            u32 requests;
+            u8 verdict;
+            u8 fsPercent;
+            u8 networkPercent;
+            u8 cpuPercent;
+        };
+        static_assert(sizeof(Summary) == 32);
+
+        // Called by TracedMethodInterface from the thread serving the request
+        void RequestStarted(s64 ticks);
+        void ResultStarted();
+        void RequestFinished();
+
+        // Adds the time until destroyed to PHASE_FS, when created by the thread
+        // serving a request. Wraps the FS calls done on behalf of the client.
+        class FSScope {
+        public:
+            FSScope();
+            ~FSScope();
+        private:
+            s64 start;
+        };
+
+        // Current session, or the previous one until the next request arrives
+        Summary GetSummary();
+
+        inline const char* VerdictName(u8 verdict) {
+            switch (verdict) {
+            case VERDICT_FS: return "FS";
+            case VERDICT_NETWORK: return "Network";
+            case VERDICT_CPU: return "CPU";
+            default: return "None";
+            }
+        }
+
+        // Called after every session
+        bool EndSession();
+    }
+}
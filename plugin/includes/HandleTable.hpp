@@ -0,0 +1,51 @@
+#pragma once
+#include "3ds.h"
+#include "CTRPluginFramework/System/Mutex.hpp"
+
+namespace ArticFunctions {
+
+    // Fixed capacity table of the FS handles given to the client. The client only
+    // sees tokens made of a slot index and a generation counter, so stale or made
+    // up handles are rejected before reaching the FS service.
+    class HandleTable {
+    public:
+        enum class Type : u8 {
+            NONE,
+            FILE,
+            DIR,
+            ARCHIVE,
+        };
+
+        static constexpr u32 CAPACITY = 512;
+
+        HandleTable();
+
+        // Returns the token for the handle, or 0 if the table is full
+        u32 Insert(Type type, u64 handle);
+        bool Get(u32 token, Type type, u64& handle);
+        bool Erase(u32 token, Type type, u64& handle);
+
+        // Calls closeFunc for every handle in the table and empties it
+        void Clear(void (*closeFunc)(Type type, u64 handle));
+
+        size_t Count();
+
+    private:
+        struct Slot {
+            u64 handle;
+            u16 generation;
+            Type type;
+        };
+
+        static u32 MakeToken(u32 index, u16 generation) {
+            return ((u32)generation << 16) | index;
+        }
+
+        Slot* Find(u32 token, Type type);
+
+        Slot slots[CAPACITY];
+        u16 freeSlots[CAPACITY];
+        u32 freeCount;
+        CTRPluginFramework::Mutex mutex;
+    };
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "3ds/types.h"
+
+namespace ArticFunctions {
+
+    // Decoder for the backwards LZSS variant used by compressed code binaries (.code)
+    u32 lzss_get_decompressed_size(const u8* compressed, u32 compressedsize);
+    int lzss_decompress(const u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize);
+
+    // Same as lzss_decompress, also computing checksum = (checksum + word) * multiplier over all
+    // the 64-bit words of the output while they are still in cache. Always sets checksum.
+    int lzss_decompress_checksum(const u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize, u64 multiplier, u64& checksum);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "3ds.h"
+
+namespace ArticFunctions {
+
+    // Live counters of the server, served in the Prometheus text format by a small
+    // HTTP listener on METRICS_PORT: GET /metrics. Requests are counted by
+    // TracedMethodInterface, the caches, heap and handles are read when scraped.
+    // The listener has no authentication, it only runs while METRICS_ENABLE_PATH
+    // exists on the SD card.
+    namespace Metrics {
+
+        constexpr const char* METRICS_ENABLE_PATH = "/3ds/AzaharArticSetup/metrics.enable";
+
+        // Upper bounds of the request duration histogram, in microseconds
+        constexpr u32 DURATION_BUCKETS_US[] = {100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000};
+        constexpr size_t DURATION_BUCKET_COUNT = sizeof(DURATION_BUCKETS_US) / sizeof(DURATION_BUCKETS_US[0]);
+
+        struct MethodMetrics {
+            const char* name;
+            u64 requests[3]; // By SessionTrace::Status
+            u64 failures; // Finished good with a failed result
+            u64 requestBytes;
+            u64 responseBytes;
+            u64 durationUs;
+            u64 durationBuckets[DURATION_BUCKET_COUNT + 1];
+        };
+
+        // Returns the counters of a method, created on first use and never freed
+        MethodMetrics& GetMethod(const char* name);
+        void RecordRequest(MethodMetrics& method, u8 status, Result result, u32 requestBytes, u32 responseBytes, u32 durationUs);
+
+        // Checks if the listener is enabled, called once on startup
+        bool Setup();
+        bool IsEnabled();
+
+        // Called after every session
+        bool EndSession();
+
+        // The listener needs sockets to be initialized, does nothing if the port is 0
+        bool StartServer(int port);
+        void StopServer();
+    }
+}
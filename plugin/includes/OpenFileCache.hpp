@@ -0,0 +1,54 @@
+#pragma once
+#include "3ds.h"
+#include <string>
+
+namespace ArticFunctions {
+
+    // Keeps read-only files opened by the client open after they are closed, keyed by
+    // archive and path, so that opening the same path again doesn't need any FS IPC.
+    // Failed opens are remembered too. Cached handles can be shared by multiple
+    // client handles and everything is released when the client disconnects.
+    // Anything that creates or changes a file must call InvalidatePath first.
+    namespace OpenFileCache {
+
+        constexpr size_t MAX_ENTRIES = 32;
+
+        // Since the plugin started
+        struct Stats {
+            u32 hits;
+            u32 misses;
+            // Lookups done by the prefetch worker, not counted above
+            u32 prefetchHits;
+            u32 prefetchMisses;
+        };
+
+        // Builds the key for FSUSER_OpenFileDirectly (archive is the archive ID and archivePath
+        // is set) or FSUSER_OpenFile (archive is the archive handle and archivePath is null)
+        std::string MakeKey(u64 archive, const FS_Path* archivePath, const FS_Path& filePath);
+
+        // Returns true if the open was served from the cache, in which case res holds
+        // the result of the open and handle is a cache owned handle if it succeeded
+        bool Open(const std::string& key, Result& res, Handle& handle, bool prefetch = false);
+        // Stores the result of an open done by the caller. Returns true if the cache
+        // took ownership of the handle.
+        bool Insert(const std::string& key, const FS_Path& filePath, Result res, Handle handle);
+        // Drops a client reference to a handle, returns false if the handle
+        // is not owned by the cache and must be closed by the caller
+        bool Release(Handle handle);
+
+        bool GetSize(Handle handle, u64& size);
+        void SetSize(Handle handle, u64 size);
+        bool GetAttributes(Handle handle, u32& attributes);
+        void SetAttributes(Handle handle, u32 attributes);
+
+        // Forgets every entry from an archive handle that is about to be closed
+        void InvalidateArchive(u64 archive);
+        // Forgets every entry for the file path in any archive, including failed opens.
+        // Handles still used by the client stay open but lose their cached size and attributes.
+        void InvalidatePath(const FS_Path& filePath);
+
+        bool Clear();
+
+        Stats GetStats();
+    }
+}
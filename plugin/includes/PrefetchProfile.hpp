@@ -0,0 +1,32 @@
+#pragma once
+#include "3ds.h"
+
+namespace ArticFunctions {
+
+    // Records the file opens and reads of a session and saves them to the SD card when
+    // the session succeeds. On the next connection the saved profile is followed along
+    // the requests of the client, and the next few opens and small reads are done ahead
+    // of time by a low priority thread, warming the open file cache and the read
+    // coalescer. Prefetching stops if the client stops following the profile. The
+    // thread also loads the profile, so the client's requests never wait for the SD card.
+    namespace PrefetchProfile {
+
+        constexpr const char* PROFILE_PATH = "/3ds/AzaharArticSetup/prefetch.bin";
+        constexpr u32 MAX_EVENTS = 2048;
+        constexpr u32 LOOKAHEAD = 4;
+
+        // Called by the FS handlers after the operation succeeded
+        void ArchiveOpened(u64 archive, u32 archiveID, const FS_Path& archivePath);
+        // Except this one, called before closing. Waits for a prefetch opening a file from the archive.
+        void ArchiveClosed(u64 archive);
+        void FileOpenedDirectly(Handle file, u32 archiveID, const FS_Path& archivePath, const FS_Path& filePath);
+        void FileOpened(Handle file, u64 archive, const FS_Path& filePath);
+        void FileRead(Handle file, u64 offset, u32 size);
+
+        // The recorded session is only saved if this was called
+        void MarkSuccess();
+
+        // Stops prefetching and saves the profile if needed
+        bool Finish();
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "3ds.h"
+
+namespace ArticFunctions {
+
+    // Serves small file reads from aligned blocks. Small reads are rounded out to
+    // BLOCK_SIZE boundaries and the blocks are kept, so neighbouring or overlapping
+    // reads don't need another FS request. Large reads go straight to FS and only
+    // keep their edge blocks. Only valid for files that are not written while open.
+    namespace ReadCoalescer {
+
+        constexpr u32 BLOCK_SIZE = 0x1000;
+        constexpr u32 BLOCK_COUNT = 16;
+        constexpr u32 MAX_COALESCED_READ = 0x4000;
+
+        struct Stats {
+            u32 requests;
+            u32 fsReads;
+            u32 blockHits;
+            u64 bytesFromBlocks;
+        };
+
+        // fsTicks is the time spent in FS reads, 0 if served from retained blocks
+        Result Read(Handle file, u64 offset, void* out, u32 size, u32& bytesRead, s64& fsTicks);
+        // Must be called before the file handle is closed
+        void Forget(Handle file);
+
+        Stats GetStats();
+        // Logs the session stats and forgets every block
+        bool Clear();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "3ds.h"
+#include <vector>
+
+namespace ArticFunctions {
+
+    // Size classed pool for the temporary buffers of the handlers: the compressed
+    // NIM, read coalescer blocks and prefetch reads. Freed blocks are kept (up to
+    // MAX_RETAINED bytes) and reused by later requests of the same class instead of
+    // going back to the plugin heap, so that repeated large temporaries don't
+    // fragment it. Request parameters and result buffers are allocated by
+    // ArticProtocolServer and don't go through the pool.
+    namespace ScratchPool {
+
+        constexpr size_t MIN_CLASS_SIZE = 0x1000;
+        constexpr size_t MAX_RETAINED = 0x40000;
+        // Bigger blocks could never be retained, they are allocated with their exact size
+        constexpr size_t MAX_CLASS_SIZE = MAX_RETAINED;
+
+        struct Stats {
+            size_t inUse;
+            size_t highWater;
+            size_t retained;
+            u32 poolHits;
+            u32 poolMisses;
+            // Big allocations EnsureAvailable couldn't make room for
+            u32 largeFailures;
+            size_t lastFailedSize;
+            // From mallinfo, nothing is allocated to measure them
+            size_t heapUsed;
+            size_t heapFree;
+            size_t heapTopFree; // At the end of the heap, where big blocks come from
+            u32 heapFreeChunks;
+            // Free bytes in holes between used blocks, 100 * (1 - top free / free)
+            u32 fragmentationPercent;
+        };
+
+        // Returns nullptr if the memory cannot be found even after trimming
+        // the pool and evicting the artifact cache
+        void* Allocate(size_t size);
+        void Free(void* ptr);
+
+        // Makes sure a block of the specified size can be allocated from the heap, releasing
+        // retained blocks and cached artifacts if needed. Used right before reserving big
+        // result buffers, by the thread that reserves them.
+        bool EnsureAvailable(size_t size);
+
+        // Returns every retained block to the heap
+        bool Trim();
+
+        Stats GetStats();
+        void LogStats();
+
+        // Per request allocations, all released to the pool when the arena goes out of scope
+        class Arena {
+        public:
+            Arena() = default;
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+            ~Arena();
+
+            void* Allocate(size_t size);
+
+        private:
+            std::vector<void*> blocks;
+        };
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "3ds.h"
+#include "CTRPluginFramework/System/Mutex.hpp"
+
+namespace ArticFunctions {
+
+    // System service session that is opened on first use and kept open until
+    // the client disconnects, so handlers don't pay the session setup per request.
+    class ServiceSession {
+    public:
+        ServiceSession(CTRPluginFramework::Mutex& mutex, Result (*openFunc)(void), void (*closeFunc)(void)) :
+            mutex(mutex), openFunc(openFunc), closeFunc(closeFunc) {}
+
+        Result Acquire();
+        void Release();
+        // Closes the session once its last reference is released
+        void Close();
+
+    private:
+        void CloseLocked();
+
+        CTRPluginFramework::Mutex& mutex;
+        Result (*openFunc)(void);
+        void (*closeFunc)(void);
+        u32 refCount = 0;
+        bool opened = false;
+        bool closePending = false;
+    };
+
+    // Holds a reference to a session for the lifetime of the object
+    class ServiceSessionRef {
+    public:
+        explicit ServiceSessionRef(ServiceSession& session) : session(session), result(session.Acquire()) {}
+        ~ServiceSessionRef() {
+            if (R_SUCCEEDED(result))
+                session.Release();
+        }
+
+        Result GetResult() const { return result; }
+
+    private:
+        ServiceSession& session;
+        Result result;
+    };
+
+    namespace ServiceSessions {
+        extern ServiceSession am;
+        extern ServiceSession cfg;
+        extern ServiceSession loader;
+        // Stolen PxiFS0 session with the NAND CTR FS archive open
+        extern ServiceSession pxiFS;
+
+        // Only valid while holding a reference to pxiFS
+        Handle GetPxiFSHandle();
+        FSPXI_Archive GetPxiFSNandArchive();
+
+        bool CloseAll();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "3ds.h"
+#include <string>
+
+namespace ArticFunctions {
+
+    // Optional binary trace of every request, replayed on the host with
+    // host/bench/TraceReplay. Tracing is enabled while TRACE_ENABLE_PATH exists on
+    // the SD card, every session is appended to TRACE_PATH.
+    //
+    // File layout: FileHeader, then records. A session starts with a single
+    // RECORD_SESSION byte, each request is a RequestRecord followed by the method
+    // name, the parameters and the handle returned by the request, if it opened one.
+    // Parameters are a ParameterType byte followed by 1, 2, 4 or 8 bytes for integers,
+    // or a u16 size and the data for buffers.
+    namespace SessionTrace {
+
+        constexpr const char* TRACE_PATH = "/3ds/AzaharArticSetup/trace.bin";
+        constexpr const char* TRACE_ENABLE_PATH = "/3ds/AzaharArticSetup/trace.enable";
+        constexpr u32 TRACE_MAGIC = 0x52544141; // AATR
+        constexpr u16 TRACE_VERSION = 1;
+
+        enum RecordType : u8 {
+            RECORD_SESSION = 1,
+            RECORD_REQUEST = 2,
+        };
+
+        enum ParameterType : u8 {
+            PARAMETER_S8 = 0,
+            PARAMETER_S16 = 1,
+            PARAMETER_S32 = 2,
+            PARAMETER_S64 = 3,
+            PARAMETER_BUFFER = 4,
+        };
+
+        enum Status : u8 {
+            STATUS_GOOD = 0,
+            STATUS_INTERNAL_ERROR = 1,
+            // The handler returned without finishing, the connection was dropped
+            STATUS_NOT_FINISHED = 2,
+        };
+
+        struct FileHeader {
+            u32 magic;
+            u16 version;
+            u16 reserved;
+            u32 firmVersion;
+        };
+
+        struct RequestRecord {
+            u8 type;
+            u8 methodLength;
+            u8 parameterCount;
+            u8 status;
+            s32 result;
+            // Time since the start of the previous request of the session
+            u32 gapUs;
+            u32 durationUs;
+            u32 resultBytes;
+            u8 resultBuffers;
+            // Size of the handle at the end of the record, 0 if none
+            u8 handleSize;
+            u16 reserved;
+        };
+        static_assert(sizeof(RequestRecord) == 24);
+
+        // Checks if tracing is enabled, called once on startup
+        bool Setup();
+        bool IsEnabled();
+        // Queues a request record, gapUs is filled in here. The records are written
+        // to the SD card by a background thread.
+        void Append(s64 startTicks, RequestRecord& header, const std::string& body);
+        // Waits until the session is written, the next request starts a new session
+        bool End();
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "3ds.h"
+#include "ArticProtocolServer.hpp"
+#include "SessionTrace.hpp"
+#include "Metrics.hpp"
+#include <string>
+
+// Adds a function handler that goes through a TracedMethodInterface
+#define TRACED_METHOD(name, handler) \
+    {METHOD_NAME(name), [](ArticProtocolServer::MethodInterface& mi) { \
+        static Metrics::MethodMetrics& metrics = Metrics::GetMethod(name); \
+        TracedMethodInterface traced(mi, name, metrics); handler(traced); }}
+
+namespace ArticFunctions {
+
+    // Forwards to the MethodInterface of a request, counting it in the metrics and
+    // recording it in the session trace when it is enabled. Big result buffers
+    // get room made for them in the heap first. Handlers use it like the
+    // MethodInterface.
+    class TracedMethodInterface {
+    public:
+        TracedMethodInterface(ArticProtocolServer::MethodInterface& mi, const char* method, Metrics::MethodMetrics& metrics);
+        ~TracedMethodInterface();
+
+        bool GetParameterS8(s8& out);
+        bool GetParameterS16(s16& out);
+        bool GetParameterS32(s32& out);
+        bool GetParameterS64(s64& out);
+        bool GetParameterBuffer(void*& outBuff, size_t& outSize);
+        bool FinishInputParameters();
+
+        ArticProtocolCommon::Buffer* ReserveResultBuffer(u32 bufferID, size_t bufferSize);
+        ArticProtocolCommon::Buffer* ResizeLastResultBuffer(ArticProtocolCommon::Buffer* buffer, size_t newSize);
+
+        // Marks a result as a handle, so the trace can map it on replay
+        void SetResultHandle(const void* handle, size_t size);
+
+        void FinishGood(int returnValue);
+        void FinishInternalError();
+
+    private:
+        void AddParameter(u8 type, const void* data, size_t size);
+
+        ArticProtocolServer::MethodInterface& mi;
+        Metrics::MethodMetrics& metrics;
+        bool tracing;
+        s64 startTicks = 0;
+        // Filled even when not tracing, the metrics use it
+        SessionTrace::RequestRecord header = {};
+        // Method name and parameters
+        std::string body;
+        u32 parameterBytes = 0;
+        u8 resultHandle[8];
+    };
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "3ds.h"
+
+namespace ArticFunctions {
+
+    // Estimates the network and FS throughput of the session from the file reads
+    // being served, and derives the read chunk size that the client should use.
+    // Estimates are moving averages, so the recommendation follows the conditions
+    // of the connection as they change.
+    namespace TransferTuner {
+
+        constexpr u32 MIN_CHUNK_SIZE = 0x4000;
+
+        struct Hints {
+            u32 chunkSize;
+            u32 netBytesPerSecond;
+            u32 fsBytesPerSecond;
+            u32 roundTripUs;
+            u32 fsLatencyUs;
+        };
+
+        // Called by TracedMethodInterface when any request arrives and before its result is sent
+        void RequestStarted(s64 ticks);
+        void ResultStarted();
+        // Called by FSFILE_Read once the data is read, fsTicks is 0 if no FS read was needed
+        void ReadFinished(u32 bytes, s64 fsTicks);
+
+        // maxChunkSize is the biggest chunk the server can currently serve
+        Hints GetHints(u32 maxChunkSize);
+
+        bool Reset();
+    }
+}
@@ -3,12 +3,26 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <algorithm>
 
 #include "ArticFunctions.hpp"
 #include "Main.hpp"
 #include "CTRPluginFramework/CTRPluginFramework.hpp"
 #include "CTRPluginFramework/Clock.hpp"
 #include "nim_extheader.h"
+#include "LZSS.hpp"
+#include "ArtifactCache.hpp"
+#include "ServiceSessions.hpp"
+#include "HandleTable.hpp"
+#include "OpenFileCache.hpp"
+#include "ScratchPool.hpp"
+#include "TransferTuner.hpp"
+#include "ReadCoalescer.hpp"
+#include "PrefetchProfile.hpp"
+#include "SessionTrace.hpp"
+#include "TracedMethodInterface.hpp"
+#include "Metrics.hpp"
+#include "Bottleneck.hpp"
 
 extern "C" {
 #include "csvc.h"
@@ -17,21 +31,19 @@ extern "C" {
 extern bool isControllerMode;
 constexpr u32 INITIAL_SETUP_APP_VERSION = 2;
 
-enum class HandleType {
-    FILE,
-    DIR,
-    ARCHIVE
-};
-
 namespace ArticFunctions {
 
     ExHeader_Info lastAppExheader;
-    std::map<u64, HandleType> openHandles;
-    CTRPluginFramework::Mutex amMutex;
-    CTRPluginFramework::Mutex cfgMutex;
+    HandleTable openHandles;
+    constexpr Result RES_INVALID_HANDLE = MAKERESULT(RL_PERMANENT, RS_WRONGARG, RM_FS, RD_INVALID_HANDLE);
+    constexpr Result RES_TOO_MANY_HANDLES = MAKERESULT(RL_PERMANENT, RS_OUTOFRESOURCE, RM_FS, RD_OUT_OF_MEMORY);
+    constexpr Result RES_INVALID_SIZE = MAKERESULT(RL_PERMANENT, RS_INVALIDARG, RM_FS, RD_INVALID_SIZE);
+    // Largest result buffer reserved for a single file or directory read, bigger
+    // requests are served short and the client continues from where it stopped
+    constexpr u32 MAX_READ_WINDOW = 0x100000;
     bool isAzaharCalled = false;
 
-    void Process_GetTitleID(ArticProtocolServer::MethodInterface& mi) {
+    void Process_GetTitleID(TracedMethodInterface& mi) {
         bool good = true;
 
         if (good) good = mi.FinishInputParameters();
@@ -50,7 +62,7 @@ namespace ArticFunctions {
         mi.FinishGood(0);
     }
 
-    void Process_GetProductInfo(ArticProtocolServer::MethodInterface& mi) {
+    void Process_GetProductInfo(TracedMethodInterface& mi) {
         bool good = true;
 
         if (good) good = mi.FinishInputParameters();
@@ -74,7 +86,7 @@ namespace ArticFunctions {
         mi.FinishGood(0);
     }
 
-    void Process_GetExheader(ArticProtocolServer::MethodInterface& mi) {
+    void Process_GetExheader(TracedMethodInterface& mi) {
         bool good = true;
 
         if (good) good = mi.FinishInputParameters();
@@ -90,7 +102,7 @@ namespace ArticFunctions {
         mi.FinishGood(0);
     }
 
-    void Process_ReadCode(ArticProtocolServer::MethodInterface& mi) {
+    void Process_ReadCode(TracedMethodInterface& mi) {
         bool good = true;
         s32 offset, size;
 
@@ -105,12 +117,23 @@ namespace ArticFunctions {
             return;
         }
 
-        s64 out;
-        if (R_FAILED(svcGetProcessInfo(&out, CUR_PROCESS_HANDLE, 0x10005))) {
+        // The text, rodata and data segments are mapped one after the other
+        s64 out, text_size, rodata_size, data_size;
+        if (R_FAILED(svcGetProcessInfo(&out, CUR_PROCESS_HANDLE, 0x10005)) ||
+            R_FAILED(svcGetProcessInfo(&text_size, CUR_PROCESS_HANDLE, 0x10002)) ||
+            R_FAILED(svcGetProcessInfo(&rodata_size, CUR_PROCESS_HANDLE, 0x10003)) ||
+            R_FAILED(svcGetProcessInfo(&data_size, CUR_PROCESS_HANDLE, 0x10004))) {
             mi.FinishInternalError();
             return;
         }
         u8* start_addr = reinterpret_cast<u8*>(out);
+        s64 code_size = text_size + rodata_size + data_size;
+
+        if (offset < 0 || size < 0 || (s64)offset + size > code_size) {
+            logger.Error("Process_ReadCode: 0x%08X+0x%08X out of bounds", (u32)offset, (u32)size);
+            mi.FinishGood(RES_INVALID_SIZE);
+            return;
+        }
 
         ArticProtocolCommon::Buffer* code_buf = mi.ReserveResultBuffer(0, size);
         if (!code_buf) {
@@ -121,13 +144,28 @@ namespace ArticFunctions {
         mi.FinishGood(0);
     }
 
-    static void _Process_ReadExefs(ArticProtocolServer::MethodInterface& mi, const char* section) {
+    static void _Process_ReadExefs(TracedMethodInterface& mi, const char* section, ArtifactCache::Artifact artifact) {
         bool good = true;
 
         if (good) good = mi.FinishInputParameters();
 
         if (!good) return;
 
+        size_t cached_size;
+        const void* cached = ArtifactCache::Pin(artifact, cached_size);
+        if (cached) {
+            ArticProtocolCommon::Buffer* cached_buf = mi.ReserveResultBuffer(0, cached_size);
+            if (cached_buf) {
+                memcpy(cached_buf->data, cached, cached_size);
+            }
+            ArtifactCache::Unpin(artifact);
+            if (!cached_buf) {
+                return;
+            }
+            mi.FinishGood(0);
+            return;
+        }
+
         // Set up FS_Path structures
         u8 path[0xC] = {0};
         u32* type = (u32*)path;
@@ -141,14 +179,14 @@ namespace ArticFunctions {
 
         // Open the RomFS file and mount it
         Handle fd = 0;
-        Result rc = FSUSER_OpenFileDirectly(&fd, ARCHIVE_ROMFS, archPath, filePath, FS_OPEN_READ, 0);
+        Result rc = FS_TIMED(FSUSER_OpenFileDirectly(&fd, ARCHIVE_ROMFS, archPath, filePath, FS_OPEN_READ, 0));
         if (R_FAILED(rc)) {
             mi.FinishGood(rc);
             return;
         }
 
         u64 file_size;
-        rc = FSFILE_GetSize(fd, &file_size);
+        rc = FS_TIMED(FSFILE_GetSize(fd, &file_size));
         if (R_FAILED(rc)) {
             FSFILE_Close(fd);
             mi.FinishGood(rc);
@@ -162,7 +200,7 @@ namespace ArticFunctions {
         }
 
         u32 bytes_read;
-        rc = FSFILE_Read(fd, &bytes_read, 0, icon_buf->data, icon_buf->bufferSize);
+        rc = FS_TIMED(FSFILE_Read(fd, &bytes_read, 0, icon_buf->data, icon_buf->bufferSize));
         if (R_FAILED(rc)) {
             FSFILE_Close(fd);
             mi.ResizeLastResultBuffer(icon_buf, 0);
@@ -170,25 +208,27 @@ namespace ArticFunctions {
             return;
         }
 
+        FS_TIMED(FSFILE_Close(fd));
+        // Stored before resizing, which can move the buffer
+        ArtifactCache::Store(artifact, icon_buf->data, bytes_read);
         mi.ResizeLastResultBuffer(icon_buf, bytes_read);
-        FSFILE_Close(fd);
 
         mi.FinishGood(0);
     }
 
-    void Process_ReadIcon(ArticProtocolServer::MethodInterface& mi) {
-        _Process_ReadExefs(mi, "icon");
+    void Process_ReadIcon(TracedMethodInterface& mi) {
+        _Process_ReadExefs(mi, "icon", ArtifactCache::Artifact::EXEFS_ICON);
     }
 
-    void Process_ReadBanner(ArticProtocolServer::MethodInterface& mi) {
-        _Process_ReadExefs(mi, "banner");
+    void Process_ReadBanner(TracedMethodInterface& mi) {
+        _Process_ReadExefs(mi, "banner", ArtifactCache::Artifact::EXEFS_BANNER);
     }
 
-    void Process_ReadLogo(ArticProtocolServer::MethodInterface& mi) {
-        _Process_ReadExefs(mi, "logo");
+    void Process_ReadLogo(TracedMethodInterface& mi) {
+        _Process_ReadExefs(mi, "logo", ArtifactCache::Artifact::EXEFS_LOGO);
     }
 
-    bool GetFSPath(ArticProtocolServer::MethodInterface& mi, FS_Path& path) {
+    bool GetFSPath(TracedMethodInterface& mi, FS_Path& path) {
         void* pathPtr; size_t pathSize;
         
         if (!mi.GetParameterBuffer(pathPtr, pathSize))
@@ -205,7 +245,24 @@ namespace ArticFunctions {
         return true;
     }
 
-    void FSUSER_OpenFileDirectly_(ArticProtocolServer::MethodInterface& mi) {
+    // Files may be shared with the open file cache, which closes them once unused
+    static Result CloseFile(Handle file) {
+        if (OpenFileCache::Release(file))
+            return 0;
+        ReadCoalescer::Forget(file);
+        return FS_TIMED(FSFILE_Close(file));
+    }
+
+    static Result GetFileSize(Handle file, u64& size) {
+        if (OpenFileCache::GetSize(file, size))
+            return 0;
+        Result res = FS_TIMED(FSFILE_GetSize(file, &size));
+        if (R_SUCCEEDED(res))
+            OpenFileCache::SetSize(file, size);
+        return res;
+    }
+
+    void FSUSER_OpenFileDirectly_(TracedMethodInterface& mi) {
         bool good = true;
 
         s32 archiveID;
@@ -225,7 +282,18 @@ namespace ArticFunctions {
         if (!good) return;
 
         Handle out;
-        Result res = FSUSER_OpenFileDirectly(&out, (FS_ArchiveID)archiveID, archPath, filePath, openFlags, attributes);
+        Result res;
+        if (openFlags == FS_OPEN_READ) {
+            std::string key = OpenFileCache::MakeKey((u32)archiveID, &archPath, filePath);
+            if (!OpenFileCache::Open(key, res, out)) {
+                res = FS_TIMED(FSUSER_OpenFileDirectly(&out, (FS_ArchiveID)archiveID, archPath, filePath, openFlags, attributes));
+                OpenFileCache::Insert(key, filePath, res, out);
+            }
+        } else {
+            // Cached handles and failed opens of the file may not be valid after this
+            OpenFileCache::InvalidatePath(filePath);
+            res = FS_TIMED(FSUSER_OpenFileDirectly(&out, (FS_ArchiveID)archiveID, archPath, filePath, openFlags, attributes));
+        }
 
         if (R_FAILED(res)) {
             mi.FinishGood(res);
@@ -234,17 +302,26 @@ namespace ArticFunctions {
 
         ArticProtocolCommon::Buffer* handle_buf = mi.ReserveResultBuffer(0, sizeof(Handle));
         if (!handle_buf) {
-            FSFILE_Close(out);
+            CloseFile(out);
             return;
         }
 
-        *reinterpret_cast<Handle*>(handle_buf->data) = out;
-        openHandles[(u64)out] = HandleType::FILE;
+        u32 token = openHandles.Insert(HandleTable::Type::FILE, out);
+        if (!token) {
+            CloseFile(out);
+            mi.ResizeLastResultBuffer(handle_buf, 0);
+            mi.FinishGood(RES_TOO_MANY_HANDLES);
+            return;
+        }
+        *reinterpret_cast<Handle*>(handle_buf->data) = token;
+        mi.SetResultHandle(handle_buf->data, handle_buf->bufferSize);
+        if (openFlags == FS_OPEN_READ)
+            PrefetchProfile::FileOpenedDirectly(out, (u32)archiveID, archPath, filePath);
 
         mi.FinishGood(res);
     }
 
-    void FSUSER_OpenArchive_(ArticProtocolServer::MethodInterface& mi) {
+    void FSUSER_OpenArchive_(TracedMethodInterface& mi) {
         bool good = true;
 
         s32 archiveID;
@@ -258,7 +335,7 @@ namespace ArticFunctions {
         if (!good) return;
 
         FS_Archive out;
-        Result res = FSUSER_OpenArchive(&out, (FS_ArchiveID)archiveID, archPath);
+        Result res = FS_TIMED(FSUSER_OpenArchive(&out, (FS_ArchiveID)archiveID, archPath));
 
         if (R_FAILED(res)) {
             mi.FinishGood(res);
@@ -271,13 +348,21 @@ namespace ArticFunctions {
             return;
         }
 
-        *reinterpret_cast<FS_Archive*>(handle_buf->data) = out;
-        openHandles[(u64)out] = HandleType::ARCHIVE;
+        u32 token = openHandles.Insert(HandleTable::Type::ARCHIVE, out);
+        if (!token) {
+            FSUSER_CloseArchive(out);
+            mi.ResizeLastResultBuffer(handle_buf, 0);
+            mi.FinishGood(RES_TOO_MANY_HANDLES);
+            return;
+        }
+        *reinterpret_cast<FS_Archive*>(handle_buf->data) = token;
+        mi.SetResultHandle(handle_buf->data, handle_buf->bufferSize);
+        PrefetchProfile::ArchiveOpened(out, (u32)archiveID, archPath);
 
         mi.FinishGood(res);
     }
 
-    void FSUSER_CloseArchive_(ArticProtocolServer::MethodInterface& mi) {
+    void FSUSER_CloseArchive_(TracedMethodInterface& mi) {
         bool good = true;
 
         FS_Archive archive;
@@ -288,13 +373,20 @@ namespace ArticFunctions {
 
         if (!good) return;
 
-        Result res = FSUSER_CloseArchive(archive);
-        openHandles.erase((u64)archive);
+        u64 handle;
+        if (archive > 0xFFFFFFFF || !openHandles.Erase((u32)archive, HandleTable::Type::ARCHIVE, handle)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
+        PrefetchProfile::ArchiveClosed(handle);
+        OpenFileCache::InvalidateArchive(handle);
+        Result res = FS_TIMED(FSUSER_CloseArchive((FS_Archive)handle));
 
         mi.FinishGood(res);
     }
 
-    void FSUSER_OpenFile_(ArticProtocolServer::MethodInterface& mi) {
+    void FSUSER_OpenFile_(TracedMethodInterface& mi) {
         bool good = true;
 
         FS_Archive archive;
@@ -311,40 +403,72 @@ namespace ArticFunctions {
 
         if (!good) return;
 
+        u64 archiveHandle;
+        if (archive > 0xFFFFFFFF || !openHandles.Get((u32)archive, HandleTable::Type::ARCHIVE, archiveHandle)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
         Handle out;
-        Result res = FSUSER_OpenFile(&out, archive, filePath, openFlags, attributes);
+        Result res;
+        if (openFlags == FS_OPEN_READ) {
+            std::string key = OpenFileCache::MakeKey(archiveHandle, nullptr, filePath);
+            if (!OpenFileCache::Open(key, res, out)) {
+                res = FS_TIMED(FSUSER_OpenFile(&out, (FS_Archive)archiveHandle, filePath, openFlags, attributes));
+                OpenFileCache::Insert(key, filePath, res, out);
+            }
+        } else {
+            // Cached handles and failed opens of the file may not be valid after this
+            OpenFileCache::InvalidatePath(filePath);
+            res = FS_TIMED(FSUSER_OpenFile(&out, (FS_Archive)archiveHandle, filePath, openFlags, attributes));
+        }
 
         if (R_FAILED(res)) {
             mi.FinishGood(res);
             return;
         }
 
+        // Citra always asks for the size after opening a file, provided it here.
+        u64 fileSize;
+        Result res2 = GetFileSize(out, fileSize);
+
+        // Taken before reserving the result buffers, so a full table leaves none behind
+        u32 token = openHandles.Insert(HandleTable::Type::FILE, out);
+        if (!token) {
+            CloseFile(out);
+            mi.FinishGood(RES_TOO_MANY_HANDLES);
+            return;
+        }
+
+        // Reserving a buffer can move the previous ones, so each one is filled right away
+        u64 erased;
         ArticProtocolCommon::Buffer* handle_buf = mi.ReserveResultBuffer(0, sizeof(Handle));
         if (!handle_buf) {
-            FSFILE_Close(out);
+            openHandles.Erase(token, HandleTable::Type::FILE, erased);
+            CloseFile(out);
             return;
         }
+        *reinterpret_cast<Handle*>(handle_buf->data) = token;
+        mi.SetResultHandle(handle_buf->data, handle_buf->bufferSize);
 
-        *reinterpret_cast<Handle*>(handle_buf->data) = out;
-
-        // Citra always asks for the size after opening a file, provided it here.
-        u64 fileSize;
-        Result res2 = FSFILE_GetSize(out, &fileSize);
         if (R_SUCCEEDED(res2)) {
             ArticProtocolCommon::Buffer* size_buf = mi.ReserveResultBuffer(1, sizeof(u64));
             if (!size_buf) {
-                FSFILE_Close(out);
+                openHandles.Erase(token, HandleTable::Type::FILE, erased);
+                CloseFile(out);
                 return;
             }
 
             *reinterpret_cast<u64*>(size_buf->data) = fileSize;
         }
-        openHandles[(u64)out] = HandleType::FILE;
+
+        if (openFlags == FS_OPEN_READ)
+            PrefetchProfile::FileOpened(out, archiveHandle, filePath);
 
         mi.FinishGood(res);
     }
 
-    void FSUSER_OpenDirectory_(ArticProtocolServer::MethodInterface& mi) {
+    void FSUSER_OpenDirectory_(TracedMethodInterface& mi) {
         bool good = true;
 
         FS_Archive archive;
@@ -357,8 +481,14 @@ namespace ArticFunctions {
 
         if (!good) return;
 
+        u64 archiveHandle;
+        if (archive > 0xFFFFFFFF || !openHandles.Get((u32)archive, HandleTable::Type::ARCHIVE, archiveHandle)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
         Handle out;
-        Result res = FSUSER_OpenDirectory(&out, archive, dirPath);
+        Result res = FS_TIMED(FSUSER_OpenDirectory(&out, (FS_Archive)archiveHandle, dirPath));
 
         if (R_FAILED(res)) {
             mi.FinishGood(res);
@@ -371,13 +501,20 @@ namespace ArticFunctions {
             return;
         }
 
-        *reinterpret_cast<Handle*>(handle_buf->data) = out;
-        openHandles[(u64)out] = HandleType::DIR;
+        u32 token = openHandles.Insert(HandleTable::Type::DIR, out);
+        if (!token) {
+            FSDIR_Close(out);
+            mi.ResizeLastResultBuffer(handle_buf, 0);
+            mi.FinishGood(RES_TOO_MANY_HANDLES);
+            return;
+        }
+        *reinterpret_cast<Handle*>(handle_buf->data) = token;
+        mi.SetResultHandle(handle_buf->data, handle_buf->bufferSize);
 
         mi.FinishGood(res);
     }
 
-    void FSFILE_Close_(ArticProtocolServer::MethodInterface& mi) {
+    void FSFILE_Close_(TracedMethodInterface& mi) {
         bool good = true;
         s32 handle;
 
@@ -387,13 +524,18 @@ namespace ArticFunctions {
 
         if (!good) return;
 
-        Result res = FSFILE_Close(handle);
-        openHandles.erase((u64)handle);
+        u64 file;
+        if (!openHandles.Erase(handle, HandleTable::Type::FILE, file)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
+        Result res = CloseFile((Handle)file);
 
         mi.FinishGood(res);
     }
 
-    void FSFILE_GetSize_(ArticProtocolServer::MethodInterface& mi) {
+    void FSFILE_GetSize_(TracedMethodInterface& mi) {
         bool good = true;
         s32 handle;
 
@@ -403,8 +545,14 @@ namespace ArticFunctions {
 
         if (!good) return;
 
+        u64 file;
+        if (!openHandles.Get(handle, HandleTable::Type::FILE, file)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
         u64 fileSize;
-        Result res = FSFILE_GetSize(handle, &fileSize);
+        Result res = GetFileSize((Handle)file, fileSize);
         if (R_FAILED(res)) {
             mi.FinishGood(res);
             return;
@@ -419,7 +567,7 @@ namespace ArticFunctions {
         mi.FinishGood(res);
     }
 
-    void FSFILE_GetAttributes_(ArticProtocolServer::MethodInterface& mi) {
+    void FSFILE_GetAttributes_(TracedMethodInterface& mi) {
         bool good = true;
         s32 handle;
 
@@ -429,8 +577,19 @@ namespace ArticFunctions {
 
         if (!good) return;
 
+        u64 file;
+        if (!openHandles.Get(handle, HandleTable::Type::FILE, file)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
         u32 attributes;
-        Result res = FSFILE_GetAttributes(handle, &attributes);
+        Result res = 0;
+        if (!OpenFileCache::GetAttributes((Handle)file, attributes)) {
+            res = FS_TIMED(FSFILE_GetAttributes((Handle)file, &attributes));
+            if (R_SUCCEEDED(res))
+                OpenFileCache::SetAttributes((Handle)file, attributes);
+        }
         if (R_FAILED(res)) {
             mi.FinishGood(res);
             return;
@@ -445,7 +604,7 @@ namespace ArticFunctions {
         mi.FinishGood(res);
     }
 
-    void FSFILE_Read_(ArticProtocolServer::MethodInterface& mi) {
+    void FSFILE_Read_(TracedMethodInterface& mi) {
         bool good = true;
         s32 handle, size;
         s64 offset;
@@ -461,23 +620,41 @@ namespace ArticFunctions {
 
         logger.Debug("Read o=0x%08X, l=0x%08X", (u32)offset, (u32)size);
 
+        u64 file;
+        if (!openHandles.Get(handle, HandleTable::Type::FILE, file)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
+        if (offset < 0 || size < 0) {
+            mi.FinishGood(RES_INVALID_SIZE);
+            return;
+        }
+        if ((u32)size > MAX_READ_WINDOW) {
+            logger.Debug("Read clamped to 0x%08X", MAX_READ_WINDOW);
+            size = MAX_READ_WINDOW;
+        }
+
         ArticProtocolCommon::Buffer* read_buf = mi.ReserveResultBuffer(0, size);
         if (!read_buf) {
             return;
         }
 
-        Result res = FSFILE_Read(handle, &bytes_read, offset, read_buf->data, read_buf->bufferSize);
+        s64 fsTicks;
+        Result res = ReadCoalescer::Read((Handle)file, offset, read_buf->data, read_buf->bufferSize, bytes_read, fsTicks);
         if (R_FAILED(res)) {
             mi.ResizeLastResultBuffer(read_buf, 0);
             mi.FinishGood(res);
             return;
         }
+        TransferTuner::ReadFinished(bytes_read, fsTicks);
+        PrefetchProfile::FileRead((Handle)file, offset, size);
 
         mi.ResizeLastResultBuffer(read_buf, bytes_read);
         mi.FinishGood(res);
     }
 
-    void FSDIR_Read_(ArticProtocolServer::MethodInterface& mi) {
+    void FSDIR_Read_(TracedMethodInterface& mi) {
         bool good = true;
         s32 handle;
         s32 entryCount;
@@ -489,13 +666,26 @@ namespace ArticFunctions {
 
         if (!good) return;
 
+        u64 dir;
+        if (!openHandles.Get(handle, HandleTable::Type::DIR, dir)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
+        if (entryCount < 0) {
+            mi.FinishGood(RES_INVALID_SIZE);
+            return;
+        }
+        if ((u32)entryCount > MAX_READ_WINDOW / sizeof(FS_DirectoryEntry))
+            entryCount = MAX_READ_WINDOW / sizeof(FS_DirectoryEntry);
+
         ArticProtocolCommon::Buffer* read_dir_buf = mi.ReserveResultBuffer(0, entryCount * sizeof(FS_DirectoryEntry));
         if (!read_dir_buf) {
             return;
         }
 
         u32 entries_read;
-        Result res = FSDIR_Read(handle, &entries_read, entryCount, reinterpret_cast<FS_DirectoryEntry*>(read_dir_buf->data));
+        Result res = FS_TIMED(FSDIR_Read((Handle)dir, &entries_read, entryCount, reinterpret_cast<FS_DirectoryEntry*>(read_dir_buf->data)));
         if (R_FAILED(res)) {
             mi.ResizeLastResultBuffer(read_dir_buf, 0);
             mi.FinishGood(res);
@@ -506,7 +696,7 @@ namespace ArticFunctions {
         mi.FinishGood(res);
     }
 
-    void FSDIR_Close_(ArticProtocolServer::MethodInterface& mi) {
+    void FSDIR_Close_(TracedMethodInterface& mi) {
         bool good = true;
         s32 handle;
 
@@ -516,13 +706,18 @@ namespace ArticFunctions {
 
         if (!good) return;
 
-        Result res = FSDIR_Close(handle);
-        openHandles.erase((u64)handle);
+        u64 dir;
+        if (!openHandles.Erase(handle, HandleTable::Type::DIR, dir)) {
+            mi.FinishGood(RES_INVALID_HANDLE);
+            return;
+        }
+
+        Result res = FS_TIMED(FSDIR_Close((Handle)dir));
 
         mi.FinishGood(res);
     }
 
-    void System_IsAzaharInitialSetup(ArticProtocolServer::MethodInterface& mi) {
+    void System_IsAzaharInitialSetup(TracedMethodInterface& mi) {
         // This function is stubbed, only kept for compatibility reasons
 
         bool good = true;
@@ -534,7 +729,7 @@ namespace ArticFunctions {
         mi.FinishGood(-1);
     }
 
-    void System_ArticSetupVersion(ArticProtocolServer::MethodInterface& mi) {
+    void System_ArticSetupVersion(TracedMethodInterface& mi) {
         bool good = true;
         s32 expected;
 
@@ -556,7 +751,7 @@ namespace ArticFunctions {
         mi.FinishGood(0);
     }
 
-    void System_ReportDeviceID(ArticProtocolServer::MethodInterface& mi) {
+    void System_ReportDeviceID(TracedMethodInterface& mi) {
         bool good = true;
         s32 deviceID;
 
@@ -564,7 +759,8 @@ namespace ArticFunctions {
 
         if (good) mi.FinishInputParameters();
         
-        Result res = amInit();
+        ServiceSessionRef am(ServiceSessions::am);
+        Result res = am.GetResult();
         if (R_FAILED(res)) {
             mi.FinishGood(res);
             return;
@@ -572,7 +768,6 @@ namespace ArticFunctions {
 
         u32 myDeviceID;
         res = AM_GetDeviceId(&myDeviceID);
-        amExit();
 
         if ((u32)deviceID != myDeviceID) {
             logger.Error("Azahar is linked to a different console than this one. Please unlink your previous console from emulator settings before continuing.");
@@ -583,152 +778,140 @@ namespace ArticFunctions {
         mi.FinishGood(0);
     }
 
-    void System_GetSystemFile(ArticProtocolServer::MethodInterface& mi) {
-        bool good = true;
-        s8 type;
-
-        if (good) good = mi.GetParameterS8(type);
-        
-        if (good) good = mi.FinishInputParameters();
+    enum SystemFileType : s8 {
+        SYSTEM_FILE_SECUREINFO = 0,
+        SYSTEM_FILE_LFCS,
+        SYSTEM_FILE_MOVABLE,
+        SYSTEM_FILE_OTP,
+        SYSTEM_FILE_CONSOLE_ID,
+        SYSTEM_FILE_MAC_ADDRESS,
 
-        if (!good) return;
+        SYSTEM_FILE_COUNT,
+    };
 
-        if (type < 0 || type > 5) {
-            mi.FinishGood(-1);
-            return;
-        }
+    // Failed system files still get an empty result buffer, so the buffer
+    // IDs of the files after them don't shift.
+    static bool ReserveEmptyResultBuffer(TracedMethodInterface& mi, u32 bufferID) {
+        return mi.ReserveResultBuffer(bufferID, 0) != nullptr;
+    }
 
+    // Reads the specified system file into the result buffer bufferID and stores
+    // the result in res. Returns false if the request was already finished
+    // because a result buffer couldn't be reserved.
+    static bool ReadSystemFile(TracedMethodInterface& mi, s8 type, u32 bufferID, Result& res) {
         // SecureInfo_A
-        if (type >= 0 && type <= 2) {
-            Handle fspxiHandle;
-            Result res = svcControlService(SERVICEOP_STEAL_CLIENT_SESSION, &fspxiHandle, "PxiFS0");
+        if (type >= SYSTEM_FILE_SECUREINFO && type <= SYSTEM_FILE_MOVABLE) {
+            ServiceSessionRef pxiFS(ServiceSessions::pxiFS);
+            res = pxiFS.GetResult();
             if (R_FAILED(res)) {
-                mi.FinishGood(res);
-                return;
-            }
-            FSPXI_Archive archive;
-            res = FSPXI_OpenArchive(fspxiHandle, &archive, ARCHIVE_NAND_CTR_FS, fsMakePath(PATH_EMPTY, ""));
-            if (R_FAILED(res)) {
-                svcCloseHandle(fspxiHandle);
-                mi.FinishGood(res);
-                return;
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
+            Handle fspxiHandle = ServiceSessions::GetPxiFSHandle();
+            FSPXI_Archive archive = ServiceSessions::GetPxiFSNandArchive();
 
             const char* files[] = {"/rw/sys/SecureInfo_", "/rw/sys/LocalFriendCodeSeed_", "/private/movable.sed"};
             char file_name[0x20] = {0};
             strcpy(file_name, files[type]);
             char* end = file_name + strlen(files[type]);
 
-            if (type == 0) {
+            if (type == SYSTEM_FILE_SECUREINFO) {
                 // Check for region changed file first
                 *end = 'C';
-            } else if (type == 1) {
+            } else if (type == SYSTEM_FILE_LFCS) {
                 *end = 'A';
             }
 
             FSPXI_File file;
-            res = FSPXI_OpenFile(fspxiHandle, &file, archive, fsMakePath(PATH_ASCII, file_name), FS_OPEN_READ, 0);
-            if (type == 0) {
+            res = FS_TIMED(FSPXI_OpenFile(fspxiHandle, &file, archive, fsMakePath(PATH_ASCII, file_name), FS_OPEN_READ, 0));
+            if (type == SYSTEM_FILE_SECUREINFO) {
                 if (R_SUCCEEDED(res)) {
                     logger.Info("NOTE: This console is region changed,\n    some functionality may not work properly.");
                 } else {
                     *end = 'A';
-                    res = FSPXI_OpenFile(fspxiHandle, &file, archive, fsMakePath(PATH_ASCII, file_name), FS_OPEN_READ, 0);
+                    res = FS_TIMED(FSPXI_OpenFile(fspxiHandle, &file, archive, fsMakePath(PATH_ASCII, file_name), FS_OPEN_READ, 0));
                 }
             }
             if (R_FAILED(res)) {
                 *end = 'B';
-                res = FSPXI_OpenFile(fspxiHandle, &file, archive, fsMakePath(PATH_ASCII, file_name), FS_OPEN_READ, 0);
+                res = FS_TIMED(FSPXI_OpenFile(fspxiHandle, &file, archive, fsMakePath(PATH_ASCII, file_name), FS_OPEN_READ, 0));
                 if (R_FAILED(res)) {
-                    FSPXI_CloseArchive(fspxiHandle, archive);
-                    svcCloseHandle(fspxiHandle);
-                    mi.FinishGood(res);
-                    return;
+                    return ReserveEmptyResultBuffer(mi, bufferID);
                 }
             }
 
             u64 size = 0;
-            res = FSPXI_GetFileSize(fspxiHandle, file, &size);
+            res = FS_TIMED(FSPXI_GetFileSize(fspxiHandle, file, &size));
             if (R_FAILED(res)) {
                 FSPXI_CloseFile(fspxiHandle, file);
-                FSPXI_CloseArchive(fspxiHandle, archive);
-                svcCloseHandle(fspxiHandle);
-                mi.FinishGood(res);
-                return;
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
 
-            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, (int)size);
+            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(bufferID, (int)size);
             if (!ret_buf) {
                 FSPXI_CloseFile(fspxiHandle, file);
-                FSPXI_CloseArchive(fspxiHandle, archive);
-                svcCloseHandle(fspxiHandle);
-                return;
+                return false;
             }
 
             u32 bytes_read = 0;
-            res = FSPXI_ReadFile(fspxiHandle, file, &bytes_read, 0, ret_buf->data, (u32)size);
-            FSPXI_CloseFile(fspxiHandle, file);
-            FSPXI_CloseArchive(fspxiHandle, archive);
-            svcCloseHandle(fspxiHandle);
-            mi.FinishGood(bytes_read != size ? -2 : res);
-        } else if (type == 3) {
-            Result res = amInit();
+            res = FS_TIMED(FSPXI_ReadFile(fspxiHandle, file, &bytes_read, 0, ret_buf->data, (u32)size));
+            FS_TIMED(FSPXI_CloseFile(fspxiHandle, file));
+            if (bytes_read != size) res = -2;
+            if (R_FAILED(res)) mi.ResizeLastResultBuffer(ret_buf, 0);
+        } else if (type == SYSTEM_FILE_OTP) {
+            ServiceSessionRef am(ServiceSessions::am);
+            res = am.GetResult();
             if (R_FAILED(res)) {
-                mi.FinishGood(res);
-                return;
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
 
             u32 deviceID;
             res = AM_GetDeviceId(&deviceID);
-            amExit();
             if (R_FAILED(res)) {
-                mi.FinishGood(res);
-                return;
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
             char filePath[0x50];
             sprintf(filePath, "/luma/backups/%08lX/otp.bin", deviceID);
             
             Handle file;
             
-            res = FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, filePath), FS_OPEN_READ, 0);
+            res = FS_TIMED(FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, filePath), FS_OPEN_READ, 0));
             if (R_FAILED(res)) {
                 logger.Error("Missing OTP backup on SD card, please update your luma version and/or remove the console battery.");
                 logger.Error(filePath);
-                mi.FinishGood(res);
-                return;
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
 
             u64 size = 0;
-            res = FSFILE_GetSize(file, &size);
+            res = FS_TIMED(FSFILE_GetSize(file, &size));
             if (R_FAILED(res)) {
                 FSFILE_Close(file);
-                mi.FinishGood(res);
-                return;
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
 
-            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, (int)size);
+            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(bufferID, (int)size);
             if (!ret_buf) {
                 FSFILE_Close(file);
-                return;
+                return false;
             }
 
             u32 bytes_read = 0;
-            res = FSFILE_Read(file, &bytes_read, 0, ret_buf->data, (u32)size);
-            FSFILE_Close(file);
+            res = FS_TIMED(FSFILE_Read(file, &bytes_read, 0, ret_buf->data, (u32)size));
+            FS_TIMED(FSFILE_Close(file));
             if (R_SUCCEEDED(res) && bytes_read == size) {
                 u64 check_null = *reinterpret_cast<u64*>(ret_buf->data);
                 if (check_null == 0) {
                     logger.Error("The OTP backup in your SD card is empty\n    This is an known issue with fastboot3DS\n    Dump the otp file manually and place in:");
                     logger.Error(filePath);
-                    mi.FinishGood(-3);
-                    return;
+                    res = -3;
                 }
             }
-            mi.FinishGood(bytes_read != size ? -2 : res);
-        } else if (type == 4) {
-            Result res = cfguInit();
+            if (bytes_read != size) res = -2;
+            if (R_FAILED(res)) mi.ResizeLastResultBuffer(ret_buf, 0);
+        } else if (type == SYSTEM_FILE_CONSOLE_ID) {
+            ServiceSessionRef cfg(ServiceSessions::cfg);
+            res = cfg.GetResult();
             if (R_FAILED(res)) {
-                mi.FinishGood(res);
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
 
             u64 consoleID = 0;
@@ -736,194 +919,199 @@ namespace ArticFunctions {
             res = CFGU_GetConfigInfoBlk2(0x8, 0x00090001, &consoleID);
             if (R_SUCCEEDED(res)) res = CFGU_GetConfigInfoBlk2(0x4, 0x00090002, &random);
             if (R_FAILED(res)) {
-                cfguExit();
-                mi.FinishGood(res);
+                return ReserveEmptyResultBuffer(mi, bufferID);
             }
 
-            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, 0xC);
+            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(bufferID, 0xC);
             if (!ret_buf) {
-                return;
+                return false;
             }
 
             *reinterpret_cast<u64*>(ret_buf->data) = consoleID;
             *reinterpret_cast<u32*>(ret_buf->data + 8) = random;
-
-            mi.FinishGood(res);
-        } else if (type == 5) {
-            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, 6);
+        } else if (type == SYSTEM_FILE_MAC_ADDRESS) {
+            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(bufferID, 6);
             if (!ret_buf) {
-                return;
+                return false;
             }
 
             memcpy(ret_buf->data, OS_SharedConfig->wifi_macaddr, 6);
-
-            mi.FinishGood(0);
+            res = 0;
+        } else {
+            res = -1;
+            return ReserveEmptyResultBuffer(mi, bufferID);
         }
+        return true;
     }
 
-    static u32 getle32(const u8* p)
-    {
-        return (p[0]<<0) | (p[1]<<8) | (p[2]<<16) | (p[3]<<24);
-    }
+    void System_GetSystemFile(TracedMethodInterface& mi) {
+        bool good = true;
+        s8 type;
+
+        if (good) good = mi.GetParameterS8(type);
+        
+        if (good) good = mi.FinishInputParameters();
 
-    static u32 lzss_get_decompressed_size(u8* compressed, u32 compressedsize)
-    {
-        u8* footer = compressed + compressedsize - 8;
+        if (!good) return;
 
-        u32 originalbottom = getle32(footer+4);
+        Result res;
+        if (!ReadSystemFile(mi, type, 0, res)) return;
 
-        return originalbottom + compressedsize;
+        mi.FinishGood(res);
     }
 
-    static int lzss_decompress(u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize)
-    {
-        u8* footer = compressed + compressedsize - 8;
-        u32 buffertopandbottom = getle32(footer+0);
-        //u32 originalbottom = getle32(footer+4);
-        u32 i, j;
-        u32 out = decompressedsize;
-        u32 index = compressedsize - ((buffertopandbottom>>24)&0xFF);
-        u32 segmentoffset;
-        u32 segmentsize;
-        u8 control;
-        u32 stopindex = compressedsize - (buffertopandbottom&0xFFFFFF);
+    void System_GetAllSystemFiles(TracedMethodInterface& mi) {
+        bool good = true;
 
-        memset(decompressed, 0, decompressedsize);
-        memcpy(decompressed, compressed, compressedsize);
+        if (good) good = mi.FinishInputParameters();
 
-        
-        while(index > stopindex)
-        {
-            control = compressed[--index];
-            
+        if (!good) return;
 
-            for(i=0; i<8; i++)
-            {
-                if (index <= stopindex)
-                    break;
-
-                if (index <= 0)
-                    break;
-
-                if (out <= 0)
-                    break;
-
-                if (control & 0x80)
-                {
-                    if (index < 2)
-                    {
-                        // fprintf(stderr, "Error, compression out of bounds\n");
-                        goto clean;
-                    }
-
-                    index -= 2;
-
-                    segmentoffset = compressed[index] | (compressed[index+1]<<8);
-                    segmentsize = ((segmentoffset >> 12)&15)+3;
-                    segmentoffset &= 0x0FFF;
-                    segmentoffset += 2;
-
-                    
-                    if (out < segmentsize)
-                    {
-                        // fprintf(stderr, "Error, compression out of bounds\n");
-                        goto clean;
-                    }
-
-                    for(j=0; j<segmentsize; j++)
-                    {
-                        u8 data;
-                        
-                        if (out+segmentoffset >= decompressedsize)
-                        {
-                            // fprintf(stderr, "Error, compression out of bounds\n");
-                            goto clean;
-                        }
-
-                        data  = decompressed[out+segmentoffset];
-                        decompressed[--out] = data;
-                    }
-                }
-                else
-                {
-                    if (out < 1)
-                    {
-                        // fprintf(stderr, "Error, compression out of bounds\n");
-                        goto clean;
-                    }
-                    decompressed[--out] = compressed[--index];
-                }
+        // Result buffer N holds the system file of type N, the last one holds the
+        // result of every file. Keep the sessions referenced for the whole request.
+        ServiceSessionRef pxiFS(ServiceSessions::pxiFS);
+        ServiceSessionRef am(ServiceSessions::am);
+        ServiceSessionRef cfg(ServiceSessions::cfg);
 
-                control <<= 1;
-            }
+        Result results[SYSTEM_FILE_COUNT];
+        for (s8 type = 0; type < SYSTEM_FILE_COUNT; type++) {
+            if (!ReadSystemFile(mi, type, type, results[type])) return;
         }
 
-        return 0;
-        
-        clean:
-        return -1;
+        ArticProtocolCommon::Buffer* res_buf = mi.ReserveResultBuffer(SYSTEM_FILE_COUNT, sizeof(results));
+        if (!res_buf) {
+            return;
+        }
+        memcpy(res_buf->data, results, sizeof(results));
+
+        mi.FinishGood(0);
     }
 
-    void System_GetNIM(ArticProtocolServer::MethodInterface& mi) {
+    void System_GetNIM(TracedMethodInterface& mi) {
         bool good = true;
         
         if (good) good = mi.FinishInputParameters();
 
         if (!good) return;
 
+        // The decompressed code only gets cached once its checksum is verified
+        size_t cached_size;
+        const void* cached = ArtifactCache::Pin(ArtifactCache::Artifact::NIM_CODE, cached_size);
+        if (cached) {
+            ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, nim_extheader_bin_size);
+            if (ret_buf) {
+                memcpy(ret_buf->data, nim_extheader_bin, nim_extheader_bin_size);
+                ret_buf = mi.ReserveResultBuffer(1, cached_size);
+            }
+            if (ret_buf) {
+                memcpy(ret_buf->data, cached, cached_size);
+            }
+            ArtifactCache::Unpin(ArtifactCache::Artifact::NIM_CODE);
+            if (!ret_buf) {
+                return;
+            }
+            PrefetchProfile::MarkSuccess();
+            mi.FinishGood(0);
+            return;
+        }
+
         Handle file;
         u32 archive_path[4] = {0x00002C02, 0x00040130, MEDIATYPE_NAND, 0x0};
         u32 file_path[5] = {0x0, 0x0, 0x2, 0x646F632E, 0x00000065};
         FS_Path archive_path_bin = {PATH_BINARY, 0x10, archive_path};
         FS_Path file_path_bin = {PATH_BINARY, 0x14, file_path};
-        Result res = FSUSER_OpenFileDirectly(&file, ARCHIVE_SAVEDATA_AND_CONTENT, archive_path_bin, file_path_bin, FS_OPEN_READ, 0);
+        Result res = FS_TIMED(FSUSER_OpenFileDirectly(&file, ARCHIVE_SAVEDATA_AND_CONTENT, archive_path_bin, file_path_bin, FS_OPEN_READ, 0));
         if (R_FAILED(res)) {
             mi.FinishGood(res);
             return;
         }
 
         u64 size = 0;
-        res = FSFILE_GetSize(file, &size);
+        res = FS_TIMED(FSFILE_GetSize(file, &size));
         if (R_FAILED(res)) {
             FSFILE_Close(file);
             mi.FinishGood(res);
             return;
         }
 
-        u8* buffer = (u8*)malloc((size_t)size);
+        ScratchPool::Arena arena;
+        u8* buffer = (u8*)arena.Allocate((size_t)size);
+        if (!buffer) {
+            FSFILE_Close(file);
+            mi.FinishInternalError();
+            return;
+        }
         u32 bytes_read = 0;
-        res = FSFILE_Read(file, &bytes_read, 0, buffer, (u32)size);
-        FSFILE_Close(file);
+        res = FS_TIMED(FSFILE_Read(file, &bytes_read, 0, buffer, (u32)size));
+        FS_TIMED(FSFILE_Close(file));
         if (R_FAILED(res) || bytes_read != size) {
             if (bytes_read != size) res = -2;
-            free(buffer);
             mi.FinishGood(res);
             return;
         }
 
         ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, nim_extheader_bin_size);
         if (!ret_buf) {
-            free(buffer);
             return;
         }
         memcpy(ret_buf->data, nim_extheader_bin, nim_extheader_bin_size);
         ret_buf = mi.ReserveResultBuffer(1, lzss_get_decompressed_size(buffer, (u32)size));
         if (!ret_buf) {
-            free(buffer);
             return;
         }
-        lzss_decompress(buffer, (u32)size, (u8*)ret_buf->data, ret_buf->bufferSize);
-        free(buffer);
+        u64 checksum;
+        lzss_decompress_checksum(buffer, (u32)size, (u8*)ret_buf->data, ret_buf->bufferSize, 0x6500000065ULL, checksum);
 
-        u64 checksum = 0;
-        u64* start = (u64*)(ret_buf->data), *end = (u64*)((uintptr_t)(ret_buf->data + ret_buf->bufferSize) & ~7);
-        while (start != end) checksum = (checksum + *start++) * 0x6500000065ULL;
         if (checksum != 0x50F9D326AB2239E9ULL) {
             logger.Error("Invalid NIM checksum. Please ensure your console is on the latest version");
             mi.ResizeLastResultBuffer(ret_buf, 0);
             mi.FinishGood(-3);
             return;
         }
+        // ret_buf is the last reserved buffer and was never resized, so it is still valid
+        ArtifactCache::Store(ArtifactCache::Artifact::NIM_CODE, ret_buf->data, ret_buf->bufferSize);
+        PrefetchProfile::MarkSuccess();
+
+        mi.FinishGood(0);
+    }
+
+    void System_GetTransferHints(TracedMethodInterface& mi) {
+        bool good = true;
+
+        if (good) good = mi.FinishInputParameters();
+
+        if (!good) return;
+
+        // Once a big result buffer couldn't be allocated, keep chunks well below that size
+        ScratchPool::Stats scratch = ScratchPool::GetStats();
+        u32 maxChunkSize = MAX_READ_WINDOW;
+        if (scratch.largeFailures)
+            maxChunkSize = std::min<u32>(maxChunkSize, scratch.lastFailedSize / 2);
+        TransferTuner::Hints hints = TransferTuner::GetHints(maxChunkSize);
+
+        ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, sizeof(hints));
+        if (!ret_buf) {
+            return;
+        }
+        memcpy(ret_buf->data, &hints, sizeof(hints));
+
+        mi.FinishGood(0);
+    }
+
+    void System_GetBottleneck(TracedMethodInterface& mi) {
+        bool good = true;
+
+        if (good) good = mi.FinishInputParameters();
+
+        if (!good) return;
+
+        Bottleneck::Summary summary = Bottleneck::GetSummary();
+
+        ArticProtocolCommon::Buffer* ret_buf = mi.ReserveResultBuffer(0, sizeof(summary));
+        if (!ret_buf) {
+            return;
+        }
+        memcpy(ret_buf->data, &summary, sizeof(summary));
 
         mi.FinishGood(0);
     }
@@ -935,41 +1123,46 @@ namespace ArticFunctions {
     }
 
     std::map<std::string, void(*)(ArticProtocolServer::MethodInterface& mi)> functionHandlers = {
-        {METHOD_NAME("Process_GetTitleID"), Process_GetTitleID},
-        {METHOD_NAME("Process_GetProductInfo"), Process_GetProductInfo},
-        {METHOD_NAME("Process_GetExheader"), Process_GetExheader},
-        {METHOD_NAME("Process_ReadCode"), Process_ReadCode},
-        {METHOD_NAME("Process_ReadIcon"), Process_ReadIcon},
-        {METHOD_NAME("Process_ReadBanner"), Process_ReadBanner},
-        {METHOD_NAME("Process_ReadLogo"), Process_ReadLogo},
-        {METHOD_NAME("FSUSER_OpenFileDirectly"), FSUSER_OpenFileDirectly_},
-        {METHOD_NAME("FSUSER_OpenArchive"), FSUSER_OpenArchive_},
-        {METHOD_NAME("FSUSER_CloseArchive"), FSUSER_CloseArchive_},
-        {METHOD_NAME("FSUSER_OpenFile"), FSUSER_OpenFile_},
-        {METHOD_NAME("FSUSER_OpenDirectory"), FSUSER_OpenDirectory_},
-        {METHOD_NAME("FSFILE_Close"), FSFILE_Close_},
-        {METHOD_NAME("FSFILE_GetAttributes"), FSFILE_GetAttributes_},
-        {METHOD_NAME("FSFILE_GetSize"), FSFILE_GetSize_},
-        {METHOD_NAME("FSFILE_Read"), FSFILE_Read_},
-        {METHOD_NAME("FSDIR_Read"), FSDIR_Read_},
-        {METHOD_NAME("FSDIR_Close"), FSDIR_Close_},
+        TRACED_METHOD("Process_GetTitleID", Process_GetTitleID),
+        TRACED_METHOD("Process_GetProductInfo", Process_GetProductInfo),
+        TRACED_METHOD("Process_GetExheader", Process_GetExheader),
+        TRACED_METHOD("Process_ReadCode", Process_ReadCode),
+        TRACED_METHOD("Process_ReadIcon", Process_ReadIcon),
+        TRACED_METHOD("Process_ReadBanner", Process_ReadBanner),
+        TRACED_METHOD("Process_ReadLogo", Process_ReadLogo),
+        TRACED_METHOD("FSUSER_OpenFileDirectly", FSUSER_OpenFileDirectly_),
+        TRACED_METHOD("FSUSER_OpenArchive", FSUSER_OpenArchive_),
+        TRACED_METHOD("FSUSER_CloseArchive", FSUSER_CloseArchive_),
+        TRACED_METHOD("FSUSER_OpenFile", FSUSER_OpenFile_),
+        TRACED_METHOD("FSUSER_OpenDirectory", FSUSER_OpenDirectory_),
+        TRACED_METHOD("FSFILE_Close", FSFILE_Close_),
+        TRACED_METHOD("FSFILE_GetAttributes", FSFILE_GetAttributes_),
+        TRACED_METHOD("FSFILE_GetSize", FSFILE_GetSize_),
+        TRACED_METHOD("FSFILE_Read", FSFILE_Read_),
+        TRACED_METHOD("FSDIR_Read", FSDIR_Read_),
+        TRACED_METHOD("FSDIR_Close", FSDIR_Close_),
         
-        {METHOD_NAME("System_IsAzaharInitialSetup"), System_IsAzaharInitialSetup},
-        {METHOD_NAME("System_ArticSetupVersion"), System_ArticSetupVersion},
-        {METHOD_NAME("System_ReportDeviceID"), System_ReportDeviceID},
-        {METHOD_NAME("System_GetSystemFile"), System_GetSystemFile},
-        {METHOD_NAME("System_GetNIM"), System_GetNIM},
+        TRACED_METHOD("System_IsAzaharInitialSetup", System_IsAzaharInitialSetup),
+        TRACED_METHOD("System_ArticSetupVersion", System_ArticSetupVersion),
+        TRACED_METHOD("System_ReportDeviceID", System_ReportDeviceID),
+        TRACED_METHOD("System_GetSystemFile", System_GetSystemFile),
+        TRACED_METHOD("System_GetAllSystemFiles", System_GetAllSystemFiles),
+        TRACED_METHOD("System_GetNIM", System_GetNIM),
+        TRACED_METHOD("System_GetTransferHints", System_GetTransferHints),
+        TRACED_METHOD("System_GetBottleneck", System_GetBottleneck),
     };
 
     bool obtainExheader() {
-        Result loaderInitCustom(void);
-        void loaderExitCustom(void);
         Result LOADER_GetLastApplicationProgramInfo(ExHeader_Info* exheaderInfo);
 
-
-        Result res = loaderInitCustom();
-        if (R_SUCCEEDED(res)) res = LOADER_GetLastApplicationProgramInfo(&lastAppExheader);
-        loaderExitCustom();
+        Result res;
+        {
+            ServiceSessionRef loader(ServiceSessions::loader);
+            res = loader.GetResult();
+            if (R_SUCCEEDED(res)) res = LOADER_GetLastApplicationProgramInfo(&lastAppExheader);
+        }
+        // Only needed once, don't keep the session until the first disconnect
+        ServiceSessions::loader.Close();
 
         if (R_FAILED(res)) {
             logger.Error("Failed to get ExHeader. Luma3DS may be outdated.");
@@ -980,37 +1173,49 @@ namespace ArticFunctions {
     }
 
     static bool closeHandles() {
-        auto CloseHandle = [](u64 handle, HandleType type) {
+        openHandles.Clear([](HandleTable::Type type, u64 handle) {
             switch (type)
             {
-            case HandleType::FILE:
+            case HandleTable::Type::FILE:
                 logger.Debug("Call pending FSFILE_Close");
-                FSFILE_Close((Handle)handle);
+                CloseFile((Handle)handle);
                 break;
-            case HandleType::DIR:
+            case HandleTable::Type::DIR:
                 logger.Debug("Call pending FSDIR_Close");
                 FSDIR_Close((Handle)handle);
                 break;
-            case HandleType::ARCHIVE:
+            case HandleTable::Type::ARCHIVE:
                 logger.Debug("Call pending FSUSER_CloseArchive");
                 FSUSER_CloseArchive((FS_Archive)handle);
                 break;
             default:
                 break;
             }
-        };
-        for (auto it = openHandles.begin(); it != openHandles.end(); it++) {
-            CloseHandle(it->first, it->second);
-        }
-        openHandles.clear();
+        });
         return true;
     }
 
+    static bool releaseScratch() {
+        ScratchPool::LogStats();
+        return ScratchPool::Trim();
+    }
+
     std::vector<bool(*)()> setupFunctions {
         obtainExheader,
+        SessionTrace::Setup,
+        Metrics::Setup,
     };
 
     std::vector<bool(*)()> destructFunctions {
+        Metrics::EndSession,
+        Bottleneck::EndSession,
+        PrefetchProfile::Finish,
         closeHandles,
+        OpenFileCache::Clear,
+        ReadCoalescer::Clear,
+        releaseScratch,
+        TransferTuner::Reset,
+        ServiceSessions::CloseAll,
+        SessionTrace::End,
     };
 }
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ArtifactCache.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+
+namespace ArticFunctions {
+
+    namespace ArtifactCache {
+
+        struct Entry {
+            void* data = nullptr;
+            size_t size = 0;
+            u32 lastUse = 0;
+            u32 pins = 0;
+        };
+
+        static Entry entries[static_cast<size_t>(Artifact::COUNT)];
+        static size_t totalSize = 0;
+        static u32 useCounter = 0;
+        static u32 hits = 0, misses = 0;
+        static CTRPluginFramework::Mutex cacheMutex;
+
+        static void FreeEntry(Entry& entry) {
+            free(entry.data);
+            totalSize -= entry.size;
+            entry = Entry();
+        }
+
+        static Entry* LeastRecentlyUsed(const Entry* except) {
+            Entry* lru = nullptr;
+            for (Entry& entry : entries) {
+                if (!entry.data || entry.pins || &entry == except)
+                    continue;
+                if (!lru || entry.lastUse < lru->lastUse)
+                    lru = &entry;
+            }
+            return lru;
+        }
+
+        const void* Pin(Artifact artifact, size_t& size) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry& entry = entries[static_cast<size_t>(artifact)];
+            if (!entry.data) {
+                misses++;
+                size = 0;
+                return nullptr;
+            }
+            hits++;
+            entry.pins++;
+            entry.lastUse = ++useCounter;
+            size = entry.size;
+            return entry.data;
+        }
+
+        void Unpin(Artifact artifact) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry& entry = entries[static_cast<size_t>(artifact)];
+            if (entry.pins)
+                entry.pins--;
+        }
+
+        void Store(Artifact artifact, const void* data, size_t size) {
+            if (size == 0 || size > MAX_CACHE_SIZE)
+                return;
+
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry& entry = entries[static_cast<size_t>(artifact)];
+            if (entry.pins)
+                return;
+            if (entry.data)
+                FreeEntry(entry);
+
+            while (totalSize + size > MAX_CACHE_SIZE) {
+                Entry* lru = LeastRecentlyUsed(&entry);
+                if (!lru)
+                    return;
+                FreeEntry(*lru);
+            }
+
+            void* copy = malloc(size);
+            while (!copy) {
+                Entry* lru = LeastRecentlyUsed(&entry);
+                if (!lru)
+                    return;
+                FreeEntry(*lru);
+                copy = malloc(size);
+            }
+
+            memcpy(copy, data, size);
+            entry.data = copy;
+            entry.size = size;
+            entry.lastUse = ++useCounter;
+            totalSize += size;
+        }
+
+        size_t Evict(size_t bytes) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            size_t released = 0;
+            while (released < bytes) {
+                Entry* lru = LeastRecentlyUsed(nullptr);
+                if (!lru)
+                    break;
+                released += lru->size;
+                FreeEntry(*lru);
+            }
+            return released;
+        }
+
+        void Clear() {
+            CTRPluginFramework::Lock l(cacheMutex);
+            for (Entry& entry : entries) {
+                if (entry.data && !entry.pins)
+                    FreeEntry(entry);
+            }
+        }
+
+        Stats GetStats() {
+            CTRPluginFramework::Lock l(cacheMutex);
+            return Stats{hits, misses, totalSize};
+        }
+    }
+}
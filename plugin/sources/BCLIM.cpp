@@ -43,7 +43,7 @@ namespace CTRPluginFramework {
             u16     u;
             u8      b[2];
         }           half;
-        half.u = *reinterpret_cast<u16 *>((u32)fb + offset);
+        half.u = *reinterpret_cast<u16 *>((uintptr_t)fb + offset);
         Color c;
         c.r = (half.u >> 8) & 0xF8;
         c.g = (half.u >> 3) & 0xFC;
@@ -63,7 +63,7 @@ namespace CTRPluginFramework {
         half.u  = (c.r & 0xF8) << 8;
         half.u |= (c.g & 0xFC) << 3;
         half.u |= (c.b & 0xF8) >> 3;
-        *reinterpret_cast<u16 *>((u32)fb + offset) = half.u;
+        *reinterpret_cast<u16 *>((uintptr_t)fb + offset) = half.u;
     }
 
     void BCLIM::RenderInterfaceBackend(void* usrData, bool isRead, Color* c, int posX, int posY) {
@@ -0,0 +1,86 @@
+#include "BootProfile.hpp"
+#include "CTRPluginFramework/Time.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace BootProfile {
+
+    using CTRPluginFramework::Time;
+
+    static constexpr int MAX_ENTRIES = 24;
+
+    struct Entry {
+        const char* name;
+        s64 start;
+        s64 end; // Same as start for marks, 0 while running
+    };
+
+    static Entry entries[MAX_ENTRIES];
+    static int entryCount = 0;
+    static s64 profileStart = 0;
+    static CTRPluginFramework::Mutex profileMutex;
+
+    static float ToMs(s64 ticks) {
+        return ticks / (Time::TicksPerSecond / 1000.f);
+    }
+
+    static int Add(const char* name, bool mark) {
+        s64 now = svcGetSystemTick();
+        CTRPluginFramework::Lock l(profileMutex);
+        if (entryCount >= MAX_ENTRIES)
+            return -1;
+        entries[entryCount] = {name, now, mark ? now : 0};
+        return entryCount++;
+    }
+
+    void Start() {
+        CTRPluginFramework::Lock l(profileMutex);
+        entryCount = 0;
+        profileStart = svcGetSystemTick();
+    }
+
+    Phase::Phase(const char* name) {
+        index = Add(name, false);
+    }
+
+    Phase::~Phase() {
+        s64 now = svcGetSystemTick();
+        CTRPluginFramework::Lock l(profileMutex);
+        if (index >= 0)
+            entries[index].end = now;
+    }
+
+    void Mark(const char* name) {
+        Add(name, true);
+    }
+
+    void Report(const char* title) {
+        CTRPluginFramework::Lock l(profileMutex);
+        s64 last = profileStart;
+        int slowest = -1;
+        for (int i = 0; i < entryCount; i++) {
+            const Entry& e = entries[i];
+            if (!e.end) {
+                logger.Debug("%s: %s running since %.1f ms", title, e.name, ToMs(e.start - profileStart));
+                continue;
+            }
+            if (e.end == e.start) {
+                logger.Debug("%s: %s at %.1f ms", title, e.name, ToMs(e.start - profileStart));
+            } else {
+                logger.Debug("%s: %s %.1f ms at %.1f ms", title, e.name, ToMs(e.end - e.start), ToMs(e.start - profileStart));
+                if (slowest < 0 || e.end - e.start > entries[slowest].end - entries[slowest].start)
+                    slowest = i;
+            }
+            if (e.end > last)
+                last = e.end;
+        }
+        // The only line shown without debug logging
+        if (slowest >= 0) {
+            logger.Info("%s: %.1f ms, slowest %s %.1f ms", title, ToMs(last - profileStart), entries[slowest].name,
+                ToMs(entries[slowest].end - entries[slowest].start));
+        } else {
+            logger.Info("%s: %.1f ms", title, ToMs(last - profileStart));
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#include <algorithm>
+
+#include "Bottleneck.hpp"
+#include "CTRPluginFramework/Time.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    namespace Bottleneck {
+
+        using CTRPluginFramework::Time;
+
+        // Longer gaps between requests mean the client was busy with something else.
+        // Big reads on a slow link take seconds to send, so this is larger than in TransferTuner.
+        static constexpr s64 MAX_GAP = 10 * Time::TicksPerSecond;
+
+        static s64 phaseTicks[PHASE_COUNT] = {};
+        static u32 requests = 0;
+        static bool sessionEnded = false;
+
+        // Request being served
+        static bool inRequest = false;
+        static u32 requestThread = 0;
+        static s64 requestStart = 0;
+        static s64 resultStart = 0;
+        static s64 fsTicks = 0;
+        static s64 lastEnd = 0;
+        static CTRPluginFramework::Mutex bottleneckMutex;
+
+        static u32 CurrentThreadID() {
+            u32 id = 0;
+            svcGetThreadId(&id, CUR_THREAD_HANDLE);
+            return id;
+        }
+
+        static u8 Percent(s64 part, s64 total) {
+            return (u8)((part * 100 + total / 2) / total);
+        }
+
+        static Summary Summarize() {
+            Summary summary = {};
+            s64 total = 0;
+            for (int i = 0; i < PHASE_COUNT; i++) {
+                summary.phaseUs[i] = phaseTicks[i] * 1000000 / Time::TicksPerSecond;
+                total += phaseTicks[i];
+            }
+            summary.requests = requests;
+            if (!total)
+                return summary;
+
+            s64 fs = phaseTicks[PHASE_FS];
+            s64 network = phaseTicks[PHASE_SEND];
+            s64 cpu = phaseTicks[PHASE_PREP];
+            summary.fsPercent = Percent(fs, total);
+            summary.networkPercent = Percent(network, total);
+            summary.cpuPercent = Percent(cpu, total);
+            if (fs >= network && fs >= cpu)
+                summary.verdict = VERDICT_FS;
+            else if (network >= cpu)
+                summary.verdict = VERDICT_NETWORK;
+            else
+                summary.verdict = VERDICT_CPU;
+            return summary;
+        }
+
+        void RequestStarted(s64 ticks) {
+            u32 thread = CurrentThreadID();
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            if (sessionEnded) {
+                std::fill(std::begin(phaseTicks), std::end(phaseTicks), 0);
+                requests = 0;
+                sessionEnded = false;
+            }
+            if (lastEnd) {
+                s64 gap = ticks - lastEnd;
+                if (gap > 0 && gap <= MAX_GAP)
+                    phaseTicks[PHASE_SEND] += gap;
+            }
+            inRequest = true;
+            requestThread = thread;
+            requestStart = ticks;
+            resultStart = fsTicks = 0;
+        }
+
+        void ResultStarted() {
+            s64 now = svcGetSystemTick();
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            if (inRequest && !resultStart)
+                resultStart = now;
+        }
+
+        void RequestFinished() {
+            s64 now = svcGetSystemTick();
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            if (!inRequest)
+                return;
+            // The request was received before the handler ran, reading its
+            // parameters only copies them out and counts as handler time
+            if (!resultStart)
+                resultStart = now;
+
+            s64 handler = resultStart - requestStart;
+            s64 fs = std::min(fsTicks, handler);
+            phaseTicks[PHASE_FS] += fs;
+            phaseTicks[PHASE_PREP] += handler - fs;
+            // Whatever FinishGood did, the server may send the result in it
+            phaseTicks[PHASE_SEND] += now - resultStart;
+            requests++;
+            inRequest = false;
+            lastEnd = now;
+        }
+
+        FSScope::FSScope() : start(0) {
+            u32 thread = CurrentThreadID();
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            if (inRequest && thread == requestThread)
+                start = svcGetSystemTick();
+        }
+
+        FSScope::~FSScope() {
+            if (!start)
+                return;
+            s64 now = svcGetSystemTick();
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            fsTicks += now - start;
+        }
+
+        Summary GetSummary() {
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            return Summarize();
+        }
+
+        bool EndSession() {
+            CTRPluginFramework::Lock l(bottleneckMutex);
+            Summary summary = Summarize();
+            if (summary.requests) {
+                logger.Debug("Bottleneck: %s bound, FS %u%% Net %u%% CPU %u%%", VerdictName(summary.verdict),
+                    summary.fsPercent, summary.networkPercent, summary.cpuPercent);
+                logger.Debug("Bottleneck: req=%u fs=%lluus prep=%lluus send=%lluus", summary.requests,
+                    summary.phaseUs[PHASE_FS], summary.phaseUs[PHASE_PREP], summary.phaseUs[PHASE_SEND]);
+            }
+            sessionEnded = true;
+            inRequest = false;
+            lastEnd = 0;
+            return true;
+        }
+    }
+}
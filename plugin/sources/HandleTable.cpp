@@ -0,0 +1,97 @@
+#include "HandleTable.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include <vector>
+
+namespace ArticFunctions {
+
+    HandleTable::HandleTable() {
+        for (u32 i = 0; i < CAPACITY; i++) {
+            slots[i] = Slot{.handle = 0, .generation = 1, .type = Type::NONE};
+            // Hand out the lowest slots first
+            freeSlots[i] = CAPACITY - 1 - i;
+        }
+        freeCount = CAPACITY;
+    }
+
+    HandleTable::Slot* HandleTable::Find(u32 token, Type type) {
+        u32 index = token & 0xFFFF;
+        if (index >= CAPACITY)
+            return nullptr;
+
+        Slot& slot = slots[index];
+        if (slot.type != type || slot.generation != (token >> 16))
+            return nullptr;
+        return &slot;
+    }
+
+    u32 HandleTable::Insert(Type type, u64 handle) {
+        CTRPluginFramework::Lock l(mutex);
+        if (freeCount == 0)
+            return 0;
+
+        u32 index = freeSlots[--freeCount];
+        Slot& slot = slots[index];
+        slot.handle = handle;
+        slot.type = type;
+        return MakeToken(index, slot.generation);
+    }
+
+    bool HandleTable::Get(u32 token, Type type, u64& handle) {
+        CTRPluginFramework::Lock l(mutex);
+        Slot* slot = Find(token, type);
+        if (!slot)
+            return false;
+
+        handle = slot->handle;
+        return true;
+    }
+
+    bool HandleTable::Erase(u32 token, Type type, u64& handle) {
+        CTRPluginFramework::Lock l(mutex);
+        Slot* slot = Find(token, type);
+        if (!slot)
+            return false;
+
+        handle = slot->handle;
+        slot->handle = 0;
+        slot->type = Type::NONE;
+        // Generation 0 is skipped so that tokens are never 0
+        if (++slot->generation == 0)
+            slot->generation = 1;
+        freeSlots[freeCount++] = (u16)(slot - slots);
+        return true;
+    }
+
+    void HandleTable::Clear(void (*closeFunc)(Type type, u64 handle)) {
+        // Closing goes through FS IPC, so it's done after releasing the table
+        std::vector<std::pair<Type, u64>> pending;
+        {
+            CTRPluginFramework::Lock l(mutex);
+            pending.reserve(CAPACITY - freeCount);
+            for (u32 i = 0; i < CAPACITY; i++) {
+                Slot& slot = slots[i];
+                if (slot.type == Type::NONE)
+                    continue;
+
+                pending.emplace_back(slot.type, slot.handle);
+                slot.handle = 0;
+                slot.type = Type::NONE;
+                if (++slot.generation == 0)
+                    slot.generation = 1;
+            }
+            for (u32 i = 0; i < CAPACITY; i++) {
+                freeSlots[i] = CAPACITY - 1 - i;
+            }
+            freeCount = CAPACITY;
+        }
+
+        for (auto& p : pending) {
+            closeFunc(p.first, p.second);
+        }
+    }
+
+    size_t HandleTable::Count() {
+        CTRPluginFramework::Lock l(mutex);
+        return CAPACITY - freeCount;
+    }
+}
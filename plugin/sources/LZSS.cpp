@@ -0,0 +1,194 @@
+#include <string.h>
+
+#include "LZSS.hpp"
+
+namespace ArticFunctions {
+
+    static inline u32 getle32(const u8* p)
+    {
+        return (p[0]<<0) | (p[1]<<8) | (p[2]<<16) | (p[3]<<24);
+    }
+
+    // Copies a back-reference towards lower addresses, ending right before dst_end.
+    // A displacement of 4 or more means every word read has already been written,
+    // so the copy can go a word at a time even if source and destination overlap.
+    static inline void lzss_copy_segment(u8* dst_end, u32 displacement, u32 size)
+    {
+        if (displacement >= 4) {
+            while (size >= 4) {
+                dst_end -= 4;
+                size -= 4;
+                memcpy(dst_end, dst_end + displacement, 4);
+            }
+        }
+        while (size--) {
+            dst_end--;
+            *dst_end = dst_end[displacement];
+        }
+    }
+
+    u32 lzss_get_decompressed_size(const u8* compressed, u32 compressedsize)
+    {
+        if (compressedsize < 8)
+            return compressedsize;
+
+        const u8* footer = compressed + compressedsize - 8;
+
+        u32 originalbottom = getle32(footer+4);
+
+        return originalbottom + compressedsize;
+    }
+
+    // Polynomial checksum over the 64-bit words of a buffer, h = (h + w) * multiplier.
+    // The decoder finalizes its output from the end towards the start, so whole blocks
+    // are hashed as soon as they are complete and combined as H(A||S) = H(A) * K^|S| + H(S).
+    class BlockChecksum {
+    public:
+        static constexpr u32 BLOCK_SIZE = 0x1000;
+
+        BlockChecksum(const u8* data, u32 size, u64 multiplier) : data(data), multiplier(multiplier) {
+            pending = size & ~7;
+            blockStart = (pending - 1) & ~(BLOCK_SIZE - 1);
+            blockPower = Power(BLOCK_SIZE / 8);
+        }
+
+        // Hashes every pending block that lies completely at or above offset
+        inline void Advance(u32 offset) {
+            while (pending != 0 && offset <= blockStart)
+                HashBlock();
+        }
+
+        u64 Finish() {
+            while (pending != 0)
+                HashBlock();
+            return suffixHash;
+        }
+
+    private:
+        u64 Power(u32 exponent) const {
+            u64 result = 1, base = multiplier;
+            for (; exponent; exponent >>= 1, base *= base)
+                if (exponent & 1) result *= base;
+            return result;
+        }
+
+        void HashBlock() {
+            u64 hash = 0;
+            for (u32 offset = blockStart; offset != pending; offset += 8) {
+                u64 word;
+                memcpy(&word, data + offset, sizeof(word));
+                hash = (hash + word) * multiplier;
+            }
+            suffixHash += hash * suffixPower;
+            suffixPower *= (pending - blockStart == BLOCK_SIZE) ? blockPower : Power((pending - blockStart) / 8);
+
+            pending = blockStart;
+            if (blockStart != 0) blockStart -= BLOCK_SIZE;
+        }
+
+        const u8* data;
+        u64 multiplier;
+        u64 blockPower;
+        u64 suffixHash = 0;
+        u64 suffixPower = 1;
+        u32 pending;
+        u32 blockStart;
+    };
+
+    // onProgress(out) is called whenever everything from out to the end of the output is final
+    template <typename F>
+    static int lzss_decode(const u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize, F&& onProgress)
+    {
+        if (compressedsize < 8 || decompressedsize < compressedsize)
+            return -1;
+
+        const u8* footer = compressed + compressedsize - 8;
+        u32 buffertopandbottom = getle32(footer+0);
+        u32 out = decompressedsize;
+        u32 index = compressedsize - ((buffertopandbottom>>24)&0xFF);
+        u32 stopindex = compressedsize - (buffertopandbottom&0xFFFFFF);
+
+        memset(decompressed + compressedsize, 0, decompressedsize - compressedsize);
+        memcpy(decompressed, compressed, compressedsize);
+
+        // The footer must not point the decoder outside of the compressed buffer
+        if (index > stopindex && index > compressedsize)
+            return -1;
+
+        while (index > stopindex)
+        {
+            u32 control = compressed[--index];
+
+            for (u32 bits = 8; bits != 0;)
+            {
+                if (index <= stopindex || out == 0)
+                    break;
+
+                if (control & 0x80)
+                {
+                    if (index < 2)
+                        return -1;
+
+                    index -= 2;
+
+                    u32 segmentoffset = compressed[index] | (compressed[index+1]<<8);
+                    u32 segmentsize = ((segmentoffset >> 12)&15)+3;
+                    segmentoffset &= 0x0FFF;
+                    segmentoffset += 2;
+
+                    // The furthest byte read is the first one, so checking it covers the whole segment
+                    if (out < segmentsize || out + segmentoffset >= decompressedsize)
+                        return -1;
+
+                    // Each output byte is read from segmentoffset + 1 bytes above it
+                    lzss_copy_segment(decompressed + out, segmentoffset + 1, segmentsize);
+                    out -= segmentsize;
+
+                    control <<= 1;
+                    bits--;
+                }
+                else
+                {
+                    // Consecutive literals are stored in order, copy the whole run at once
+                    u32 run = (control & 0xFF) ? __builtin_clz(control & 0xFF) - 24 : 8;
+                    if (run > bits) run = bits;
+                    if (run > index - stopindex) run = index - stopindex;
+                    if (run > out) run = out;
+
+                    index -= run;
+                    out -= run;
+                    if (run == 8) {
+                        memcpy(decompressed + out, compressed + index, 8);
+                    } else {
+                        for (u32 i = 0; i < run; i++)
+                            decompressed[out + i] = compressed[index + i];
+                    }
+
+                    control <<= run;
+                    bits -= run;
+                }
+            }
+
+            onProgress(out);
+        }
+
+        return 0;
+    }
+
+    int lzss_decompress(const u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize)
+    {
+        return lzss_decode(compressed, compressedsize, decompressed, decompressedsize, [](u32) {});
+    }
+
+    int lzss_decompress_checksum(const u8* compressed, u32 compressedsize, u8* decompressed, u32 decompressedsize, u64 multiplier, u64& checksum)
+    {
+        BlockChecksum block_checksum(decompressed, decompressedsize, multiplier);
+        int res = lzss_decode(compressed, compressedsize, decompressed, decompressedsize, [&block_checksum](u32 out) {
+            block_checksum.Advance(out);
+        });
+        // Whatever is below the last finalized block (uncompressed prefix, or the
+        // partial output of a failed decode) is hashed here
+        checksum = block_checksum.Finish();
+        return res;
+    }
+}
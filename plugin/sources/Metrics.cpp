@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Metrics.hpp"
+#include "SessionTrace.hpp"
+#include "HandleTable.hpp"
+#include "OpenFileCache.hpp"
+#include "ArtifactCache.hpp"
+#include "ReadCoalescer.hpp"
+#include "ScratchPool.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    extern HandleTable openHandles;
+
+    namespace Metrics {
+
+        static constexpr const char* STATUS_NAMES[] = {"good", "internal_error", "not_finished"};
+        // Heap usage is sampled every this many requests, mallinfo walks the free lists
+        static constexpr u32 HEAP_SAMPLE_INTERVAL = 64;
+        static constexpr int CLIENT_TIMEOUT_MS = 1000;
+
+        static bool enabled = false;
+        static std::map<std::string, MethodMetrics> methods;
+        static u64 sessions = 0;
+        static u32 requestsSinceSample = 0;
+        static size_t heapHighWater = 0;
+        static CTRPluginFramework::Mutex metricsMutex;
+
+        static int listenFD = -1;
+        static bool serverRun = false;
+        static Thread serverThread = nullptr;
+
+        // Called without holding metricsMutex, mallinfo takes the allocator lock
+        static void SampleHeap() {
+            size_t used = mallinfo().uordblks;
+            CTRPluginFramework::Lock l(metricsMutex);
+            heapHighWater = std::max(heapHighWater, used);
+        }
+
+        bool Setup() {
+            Handle file;
+            if (R_FAILED(FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, METRICS_ENABLE_PATH), FS_OPEN_READ, 0)))
+                return true;
+            FSFILE_Close(file);
+            enabled = true;
+            return true;
+        }
+
+        bool IsEnabled() {
+            return enabled;
+        }
+
+        MethodMetrics& GetMethod(const char* name) {
+            CTRPluginFramework::Lock l(metricsMutex);
+            MethodMetrics& method = methods[name];
+            method.name = name;
+            return method;
+        }
+
+        void RecordRequest(MethodMetrics& method, u8 status, Result result, u32 requestBytes, u32 responseBytes, u32 durationUs) {
+            bool sample = false;
+            {
+                CTRPluginFramework::Lock l(metricsMutex);
+                method.requests[std::min<u8>(status, 2)]++;
+                if (status == SessionTrace::STATUS_GOOD && R_FAILED(result))
+                    method.failures++;
+                method.requestBytes += requestBytes;
+                method.responseBytes += responseBytes;
+                method.durationUs += durationUs;
+
+                size_t bucket = 0;
+                while (bucket < DURATION_BUCKET_COUNT && durationUs > DURATION_BUCKETS_US[bucket])
+                    bucket++;
+                method.durationBuckets[bucket]++;
+
+                if (++requestsSinceSample >= HEAP_SAMPLE_INTERVAL) {
+                    requestsSinceSample = 0;
+                    sample = true;
+                }
+            }
+            if (sample)
+                SampleHeap();
+        }
+
+        bool EndSession() {
+            {
+                CTRPluginFramework::Lock l(metricsMutex);
+                sessions++;
+            }
+            SampleHeap();
+            return true;
+        }
+
+        static void AppendF(std::string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+        static void AppendF(std::string& out, const char* fmt, ...) {
+            char line[0x100];
+            va_list args;
+            va_start(args, fmt);
+            int len = vsnprintf(line, sizeof(line), fmt, args);
+            va_end(args);
+            if (len > 0)
+                out.append(line, std::min<size_t>(len, sizeof(line) - 1));
+        }
+
+        static void AppendHeader(std::string& out, const char* name, const char* type, const char* help) {
+            AppendF(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+        }
+
+        static void AppendValue(std::string& out, const char* name, const char* type, const char* help, unsigned long long value) {
+            AppendHeader(out, name, type, help);
+            AppendF(out, "%s %llu\n", name, value);
+        }
+
+        static std::string Render() {
+            std::string out;
+            // The stats getters take their own locks, read them first
+            OpenFileCache::Stats openFiles = OpenFileCache::GetStats();
+            ArtifactCache::Stats artifacts = ArtifactCache::GetStats();
+            ReadCoalescer::Stats reads = ReadCoalescer::GetStats();
+            ScratchPool::Stats scratch = ScratchPool::GetStats();
+            size_t handles = openHandles.Count();
+
+            // Copied so the serving thread isn't blocked while the text is formatted
+            std::vector<MethodMetrics> methods;
+            u64 sessions;
+            size_t heapHighWater;
+            {
+                CTRPluginFramework::Lock l(metricsMutex);
+                Metrics::heapHighWater = std::max(Metrics::heapHighWater, scratch.heapUsed);
+                methods.reserve(Metrics::methods.size());
+                for (auto& [name, m] : Metrics::methods)
+                    methods.push_back(m);
+                sessions = Metrics::sessions;
+                heapHighWater = Metrics::heapHighWater;
+            }
+            out.reserve(0x1000 + methods.size() * 0x600);
+
+            AppendHeader(out, "artic_requests_total", "counter", "Requests handled by method and status.");
+            for (const MethodMetrics& m : methods)
+                for (int s = 0; s < 3; s++)
+                    AppendF(out, "artic_requests_total{method=\"%s\",status=\"%s\"} %llu\n", m.name, STATUS_NAMES[s], m.requests[s]);
+            AppendHeader(out, "artic_request_failures_total", "counter", "Requests that finished with a failed result.");
+            for (const MethodMetrics& m : methods)
+                AppendF(out, "artic_request_failures_total{method=\"%s\"} %llu\n", m.name, m.failures);
+            AppendHeader(out, "artic_request_bytes_total", "counter", "Parameter bytes received by method.");
+            for (const MethodMetrics& m : methods)
+                AppendF(out, "artic_request_bytes_total{method=\"%s\"} %llu\n", m.name, m.requestBytes);
+            AppendHeader(out, "artic_response_bytes_total", "counter", "Result buffer bytes sent by method.");
+            for (const MethodMetrics& m : methods)
+                AppendF(out, "artic_response_bytes_total{method=\"%s\"} %llu\n", m.name, m.responseBytes);
+
+            AppendHeader(out, "artic_request_duration_seconds", "histogram", "Time spent in the request handler.");
+            for (const MethodMetrics& m : methods) {
+                u64 count = 0;
+                for (size_t b = 0; b < DURATION_BUCKET_COUNT; b++) {
+                    count += m.durationBuckets[b];
+                    AppendF(out, "artic_request_duration_seconds_bucket{method=\"%s\",le=\"%g\"} %llu\n", m.name, DURATION_BUCKETS_US[b] / 1e6, count);
+                }
+                count += m.durationBuckets[DURATION_BUCKET_COUNT];
+                AppendF(out, "artic_request_duration_seconds_bucket{method=\"%s\",le=\"+Inf\"} %llu\n", m.name, count);
+                AppendF(out, "artic_request_duration_seconds_sum{method=\"%s\"} %.6f\n", m.name, m.durationUs / 1e6);
+                AppendF(out, "artic_request_duration_seconds_count{method=\"%s\"} %llu\n", m.name, count);
+            }
+
+            AppendValue(out, "artic_sessions_total", "counter", "Finished client sessions.", sessions);
+            AppendValue(out, "artic_open_handles", "gauge", "FS handles held for the client.", handles);
+
+            AppendValue(out, "artic_heap_used_bytes", "gauge", "Bytes allocated from the plugin heap.", scratch.heapUsed);
+            AppendValue(out, "artic_heap_used_high_water_bytes", "gauge", "Highest sampled heap usage.", heapHighWater);
+            AppendValue(out, "artic_heap_free_bytes", "gauge", "Free bytes in the plugin heap.", scratch.heapFree);
+            AppendValue(out, "artic_heap_fragmentation_percent", "gauge", "Free heap bytes in holes between used blocks.", scratch.fragmentationPercent);
+            AppendValue(out, "artic_large_allocation_failures_total", "counter", "Big result buffers that didn't fit in the heap.", scratch.largeFailures);
+            AppendValue(out, "artic_scratch_in_use_bytes", "gauge", "Scratch buffers in use by handlers.", scratch.inUse);
+            AppendValue(out, "artic_scratch_high_water_bytes", "gauge", "Highest scratch buffer usage.", scratch.highWater);
+            AppendValue(out, "artic_scratch_pool_hits_total", "counter", "Scratch allocations served from the pool.", scratch.poolHits);
+            AppendValue(out, "artic_scratch_pool_misses_total", "counter", "Scratch allocations that went to the heap.", scratch.poolMisses);
+
+            AppendValue(out, "artic_open_file_cache_hits_total", "counter", "File opens served from the open file cache.", openFiles.hits);
+            AppendValue(out, "artic_open_file_cache_misses_total", "counter", "File opens that needed FS.", openFiles.misses);
+            AppendValue(out, "artic_open_file_cache_prefetch_lookups_total", "counter", "Open file cache lookups done by the prefetch worker.",
+                (u64)openFiles.prefetchHits + openFiles.prefetchMisses);
+            AppendValue(out, "artic_artifact_cache_hits_total", "counter", "Artifacts served from the artifact cache.", artifacts.hits);
+            AppendValue(out, "artic_artifact_cache_misses_total", "counter", "Artifacts that had to be rebuilt.", artifacts.misses);
+            AppendValue(out, "artic_artifact_cache_bytes", "gauge", "Bytes held by the artifact cache.", artifacts.size);
+            // Reset when a session ends
+            AppendValue(out, "artic_read_coalescer_requests_total", "counter", "Small reads of the current session.", reads.requests);
+            AppendValue(out, "artic_read_coalescer_fs_reads_total", "counter", "FS reads done by the read coalescer this session.", reads.fsReads);
+            AppendValue(out, "artic_read_coalescer_block_hits_total", "counter", "Small reads served from retained blocks this session.", reads.blockHits);
+            return out;
+        }
+
+        static bool SendAll(int fd, const char* data, size_t size) {
+            while (size) {
+                pollfd pfd = {fd, POLLOUT, 0};
+                if (poll(&pfd, 1, CLIENT_TIMEOUT_MS) <= 0)
+                    return false;
+                ssize_t sent = send(fd, data, size, 0);
+                if (sent <= 0)
+                    return false;
+                data += sent;
+                size -= sent;
+            }
+            return true;
+        }
+
+        static void HandleClient(int fd) {
+            char request[0x200];
+            size_t size = 0;
+            while (size < sizeof(request) - 1) {
+                pollfd pfd = {fd, POLLIN, 0};
+                if (poll(&pfd, 1, CLIENT_TIMEOUT_MS) <= 0)
+                    return;
+                ssize_t got = recv(fd, request + size, sizeof(request) - 1 - size, 0);
+                if (got <= 0)
+                    return;
+                size += got;
+                request[size] = '\0';
+                if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+                    break;
+            }
+
+            // Only the request line matters
+            bool metrics = !strncmp(request, "GET /metrics ", 13) || !strncmp(request, "GET /metrics?", 13);
+            std::string body = metrics ? Render() : "Not found, try /metrics\n";
+            char header[0x100];
+            int headerSize = snprintf(header, sizeof(header),
+                "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                metrics ? "200 OK" : "404 Not Found", (u32)body.size());
+            if (SendAll(fd, header, headerSize))
+                SendAll(fd, body.data(), body.size());
+        }
+
+        static void ServerThread(void* arg) {
+            while (serverRun) {
+                int fd = accept(listenFD, nullptr, nullptr);
+                if (fd < 0) {
+                    svcSleepThread(50000000);
+                    continue;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                HandleClient(fd);
+                shutdown(fd, SHUT_RDWR);
+                close(fd);
+            }
+        }
+
+        bool StartServer(int port) {
+            if (serverThread || port <= 0)
+                return true;
+
+            listenFD = socket(AF_INET, SOCK_STREAM, 0);
+            if (listenFD < 0) {
+                logger.Warning("Metrics: Cannot create socket");
+                return false;
+            }
+            int reuse = 1;
+            setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            struct sockaddr_in addr = {0};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port);
+            if (bind(listenFD, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFD, 2) < 0 ||
+                fcntl(listenFD, F_SETFL, fcntl(listenFD, F_GETFL, 0) | O_NONBLOCK) < 0) {
+                logger.Warning("Metrics: Failed to listen on port %d", port);
+                close(listenFD);
+                listenFD = -1;
+                return false;
+            }
+
+            s32 prio = 0;
+            svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+            serverRun = true;
+            // Lower priority than the caller so scrapes never slow down requests
+            serverThread = threadCreate(ServerThread, nullptr, 0x2000, std::min<s32>(prio + 1, 0x3F), -2, false);
+            if (!serverThread) {
+                serverRun = false;
+                close(listenFD);
+                listenFD = -1;
+                return false;
+            }
+            logger.Info("Metrics: Serving /metrics on port %d", port);
+            return true;
+        }
+
+        void StopServer() {
+            if (!serverThread)
+                return;
+            serverRun = false;
+            threadJoin(serverThread, U64_MAX);
+            threadFree(serverThread);
+            serverThread = nullptr;
+            close(listenFD);
+            listenFD = -1;
+        }
+    }
+}
@@ -0,0 +1,273 @@
+#include <ctype.h>
+#include <map>
+
+#include "OpenFileCache.hpp"
+#include "ReadCoalescer.hpp"
+#include "Bottleneck.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    namespace OpenFileCache {
+
+        struct Entry {
+            Result res = 0;
+            Handle handle = 0;
+            // Archive handle the file was opened from, 0 for FSUSER_OpenFileDirectly
+            u64 archive = 0;
+            u32 refCount = 0;
+            u32 lastUse = 0;
+            bool hasSize = false;
+            bool hasAttributes = false;
+            u64 size = 0;
+            u32 attributes = 0;
+            // File path as compared by InvalidatePath
+            std::string path;
+        };
+
+        static std::map<std::string, Entry> entries;
+        // Entries that were invalidated while still referenced by the client
+        static std::map<Handle, Entry> detached;
+        // Every open handle in entries and detached
+        static std::map<Handle, Entry*> byHandle;
+        static u32 useCounter = 0;
+        static Stats stats;
+        static CTRPluginFramework::Mutex cacheMutex;
+
+        static void CloseFile(Handle handle) {
+            ReadCoalescer::Forget(handle);
+            FS_TIMED(FSFILE_Close(handle));
+        }
+
+        static void AppendPath(std::string& key, const FS_Path& path) {
+            key.append(reinterpret_cast<const char*>(&path.type), sizeof(path.type));
+            key.append(reinterpret_cast<const char*>(&path.size), sizeof(path.size));
+            key.append(reinterpret_cast<const char*>(path.data), path.size);
+        }
+
+        // SD and NAND archives are FAT, so ASCII and UTF-16 paths are compared
+        // without case and regardless of the encoding
+        static std::string NormalizePath(const FS_Path& path) {
+            std::string out;
+            if (path.type == PATH_ASCII) {
+                const char* str = reinterpret_cast<const char*>(path.data);
+                for (u32 i = 0; i < path.size && str[i]; i++)
+                    out.push_back(tolower((u8)str[i]));
+            } else if (path.type == PATH_UTF16) {
+                const u16* str = reinterpret_cast<const u16*>(path.data);
+                for (u32 i = 0; i < path.size / 2 && str[i]; i++) {
+                    if (str[i] < 0x80) {
+                        out.push_back(tolower(str[i]));
+                    } else {
+                        out.push_back('\0');
+                        out.append(reinterpret_cast<const char*>(&str[i]), sizeof(u16));
+                    }
+                }
+            } else {
+                out.push_back('\0');
+                AppendPath(out, path);
+            }
+            return out;
+        }
+
+        static Entry* FindByHandle(Handle handle) {
+            auto it = byHandle.find(handle);
+            return it == byHandle.end() ? nullptr : it->second;
+        }
+
+        // Removes an entry, its handle stays usable until the client releases it
+        static void Detach(std::map<std::string, Entry>::iterator it) {
+            Entry& entry = it->second;
+            if (R_SUCCEEDED(entry.res)) {
+                if (entry.refCount) {
+                    Entry& moved = detached[entry.handle] = entry;
+                    moved.hasSize = moved.hasAttributes = false;
+                    byHandle[entry.handle] = &moved;
+                } else {
+                    byHandle.erase(entry.handle);
+                    CloseFile(entry.handle);
+                }
+            }
+            entries.erase(it);
+        }
+
+        static bool EvictOne() {
+            auto lru = entries.end();
+            for (auto it = entries.begin(); it != entries.end(); it++) {
+                if (it->second.refCount != 0)
+                    continue;
+                if (lru == entries.end() || it->second.lastUse < lru->second.lastUse)
+                    lru = it;
+            }
+            if (lru == entries.end())
+                return false;
+
+            Detach(lru);
+            return true;
+        }
+
+        std::string MakeKey(u64 archive, const FS_Path* archivePath, const FS_Path& filePath) {
+            std::string key;
+            key.push_back(archivePath ? 'D' : 'A');
+            key.append(reinterpret_cast<const char*>(&archive), sizeof(archive));
+            if (archivePath)
+                AppendPath(key, *archivePath);
+            AppendPath(key, filePath);
+            return key;
+        }
+
+        bool Open(const std::string& key, Result& res, Handle& handle, bool prefetch) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            auto it = entries.find(key);
+            if (it == entries.end()) {
+                (prefetch ? stats.prefetchMisses : stats.misses)++;
+                return false;
+            }
+
+            (prefetch ? stats.prefetchHits : stats.hits)++;
+            Entry& entry = it->second;
+            entry.lastUse = ++useCounter;
+            res = entry.res;
+            if (R_SUCCEEDED(res)) {
+                handle = entry.handle;
+                entry.refCount++;
+            }
+            return true;
+        }
+
+        bool Insert(const std::string& key, const FS_Path& filePath, Result res, Handle handle) {
+            // Only remember failures that won't go away by retrying
+            if (R_FAILED(res) && R_SUMMARY(res) != RS_NOTFOUND)
+                return false;
+
+            CTRPluginFramework::Lock l(cacheMutex);
+            // Another request opened the same path in the meantime
+            if (entries.find(key) != entries.end())
+                return false;
+
+            if (entries.size() >= MAX_ENTRIES && !EvictOne())
+                return false;
+
+            Entry entry;
+            entry.res = res;
+            entry.lastUse = ++useCounter;
+            if (key[0] == 'A')
+                memcpy(&entry.archive, key.data() + 1, sizeof(entry.archive));
+            entry.path = NormalizePath(filePath);
+            if (R_SUCCEEDED(res)) {
+                entry.handle = handle;
+                entry.refCount = 1;
+            }
+            Entry& stored = entries.emplace(key, entry).first->second;
+            if (R_SUCCEEDED(res))
+                byHandle[handle] = &stored;
+            return R_SUCCEEDED(res);
+        }
+
+        bool Release(Handle handle) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry* entry = FindByHandle(handle);
+            if (!entry)
+                return false;
+
+            if (entry->refCount)
+                entry->refCount--;
+
+            auto it = detached.find(handle);
+            if (entry->refCount == 0 && it != detached.end()) {
+                CloseFile(handle);
+                byHandle.erase(handle);
+                detached.erase(it);
+            }
+            return true;
+        }
+
+        bool GetSize(Handle handle, u64& size) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry* entry = FindByHandle(handle);
+            if (!entry || !entry->hasSize)
+                return false;
+
+            size = entry->size;
+            return true;
+        }
+
+        void SetSize(Handle handle, u64 size) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry* entry = FindByHandle(handle);
+            if (!entry)
+                return;
+
+            entry->size = size;
+            entry->hasSize = true;
+        }
+
+        bool GetAttributes(Handle handle, u32& attributes) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry* entry = FindByHandle(handle);
+            if (!entry || !entry->hasAttributes)
+                return false;
+
+            attributes = entry->attributes;
+            return true;
+        }
+
+        void SetAttributes(Handle handle, u32 attributes) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            Entry* entry = FindByHandle(handle);
+            if (!entry)
+                return;
+
+            entry->attributes = attributes;
+            entry->hasAttributes = true;
+        }
+
+        void InvalidateArchive(u64 archive) {
+            CTRPluginFramework::Lock l(cacheMutex);
+            for (auto it = entries.begin(); it != entries.end();) {
+                Entry& entry = it->second;
+                if (it->first[0] != 'A' || entry.archive != archive) {
+                    it++;
+                    continue;
+                }
+                Detach(it++);
+            }
+        }
+
+        void InvalidatePath(const FS_Path& filePath) {
+            std::string path = NormalizePath(filePath);
+            CTRPluginFramework::Lock l(cacheMutex);
+            for (auto it = entries.begin(); it != entries.end();) {
+                if (it->second.path != path) {
+                    it++;
+                    continue;
+                }
+                Detach(it++);
+            }
+        }
+
+        bool Clear() {
+            CTRPluginFramework::Lock l(cacheMutex);
+            for (auto& [key, entry] : entries) {
+                if (R_SUCCEEDED(entry.res)) {
+                    logger.Debug("Call cached FSFILE_Close");
+                    CloseFile(entry.handle);
+                }
+            }
+            for (auto& [handle, entry] : detached) {
+                CloseFile(handle);
+            }
+            entries.clear();
+            detached.clear();
+            byHandle.clear();
+            return true;
+        }
+
+        Stats GetStats() {
+            CTRPluginFramework::Lock l(cacheMutex);
+            return stats;
+        }
+    }
+}
@@ -0,0 +1,524 @@
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PrefetchProfile.hpp"
+#include "OpenFileCache.hpp"
+#include "ReadCoalescer.hpp"
+#include "ScratchPool.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    namespace PrefetchProfile {
+
+        static constexpr const char* PROFILE_DIR = "/3ds/AzaharArticSetup";
+        static constexpr u32 PROFILE_MAGIC = 0x50465041; // APFP
+        static constexpr u16 PROFILE_VERSION = 1;
+        static constexpr u32 MAX_PROFILE_SIZE = 0x20000;
+        static constexpr u32 MAX_PATH_SIZE = 0x300;
+        // Profile events searched from the cursor for the request the client just did
+        static constexpr u32 RESYNC_WINDOW = 16;
+        static constexpr u32 QUEUE_SIZE = 16;
+
+        enum EventType : u8 {
+            EVENT_OPEN_DIRECT = 1,
+            EVENT_OPEN = 2,
+            EVENT_READ = 3,
+        };
+
+        struct Event {
+            EventType type;
+            // Index of the open event of the file, for reads
+            u16 file = 0;
+            u32 archiveID = 0;
+            u32 size = 0;
+            u64 offset = 0;
+            // Path type followed by the path data
+            std::string archivePath;
+            std::string filePath;
+        };
+
+        struct ArchiveInfo {
+            u32 archiveID;
+            std::string path;
+            // Prefetches using the archive handle, the client's close waits for them
+            u32 pins = 0;
+            bool closing = false;
+        };
+
+        // A profile event copied for the worker, so no lock is held while it's fetched
+        struct Job {
+            Event event;
+            std::string key;
+            // Pinned archive of EVENT_OPEN
+            u64 archive = 0;
+        };
+
+        struct ProfileHeader {
+            u32 magic;
+            u16 version;
+            u16 eventCount;
+            u32 firmVersion;
+            u32 reserved;
+        };
+
+        // Current session
+        static bool loaded = false;
+        static bool success = false;
+        static std::vector<Event> recorded;
+        static std::map<Handle, u16> openFiles;
+        static std::map<u64, ArchiveInfo> archives;
+
+        // Profile of the previous session
+        static std::vector<Event> profile;
+        static bool replaying = false;
+        static u32 cursor = 0;
+        static u32 scheduled = 0;
+        static u32 matched = 0;
+        static u32 missed = 0;
+        static u32 prefetched = 0;
+
+        static u32 queue[QUEUE_SIZE];
+        static u32 queueStart = 0;
+        static u32 queueCount = 0;
+        static Thread worker = nullptr;
+        static bool workerStop = false;
+        static LightEvent workerEvent;
+        static LightEvent unpinEvent;
+        // Never held during FS IPC
+        static CTRPluginFramework::Mutex profileMutex;
+
+        static std::string PathBytes(const FS_Path& path) {
+            u32 type = path.type;
+            std::string bytes(reinterpret_cast<const char*>(&type), sizeof(type));
+            bytes.append(reinterpret_cast<const char*>(path.data), path.size);
+            return bytes;
+        }
+
+        static FS_Path ToPath(const std::string& bytes) {
+            u32 type;
+            memcpy(&type, bytes.data(), sizeof(type));
+            return FS_Path{(FS_PathType)type, (u32)(bytes.size() - sizeof(type)), bytes.data() + sizeof(type)};
+        }
+
+        static void Follow(u32 index);
+
+        static bool SameOpen(const Event& a, const Event& b) {
+            return a.type == b.type && a.archiveID == b.archiveID && a.archivePath == b.archivePath && a.filePath == b.filePath;
+        }
+
+        static bool SameEvent(const Event& fromProfile, const Event& fromSession) {
+            if (fromProfile.type != fromSession.type)
+                return false;
+            if (fromProfile.type != EVENT_READ)
+                return SameOpen(fromProfile, fromSession);
+            return fromProfile.offset == fromSession.offset && fromProfile.size == fromSession.size &&
+                SameOpen(profile[fromProfile.file], recorded[fromSession.file]);
+        }
+
+        static bool Parse(const std::vector<u8>& data, std::vector<Event>& profile) {
+            const u8* pos = data.data();
+            const u8* end = pos + data.size();
+            auto get = [&pos, end](void* out, size_t size) {
+                if ((size_t)(end - pos) < size)
+                    return false;
+                memcpy(out, pos, size);
+                pos += size;
+                return true;
+            };
+            auto getPath = [&get, &pos](std::string& path) {
+                u16 size;
+                if (!get(&size, sizeof(size)) || size < sizeof(u32) || size > MAX_PATH_SIZE)
+                    return false;
+                path.resize(size);
+                return get(path.data(), size);
+            };
+
+            ProfileHeader header;
+            if (!get(&header, sizeof(header)) || header.magic != PROFILE_MAGIC || header.version != PROFILE_VERSION ||
+                header.firmVersion != osGetFirmVersion() || header.eventCount > MAX_EVENTS)
+                return false;
+
+            profile.resize(header.eventCount);
+            for (u32 i = 0; i < header.eventCount; i++) {
+                Event& event = profile[i];
+                if (!get(&event.type, sizeof(event.type)))
+                    return false;
+                if (event.type == EVENT_READ) {
+                    if (!get(&event.file, sizeof(event.file)) || !get(&event.offset, sizeof(event.offset)) ||
+                        !get(&event.size, sizeof(event.size)))
+                        return false;
+                    if (event.file >= i || profile[event.file].type == EVENT_READ)
+                        return false;
+                } else if (event.type == EVENT_OPEN_DIRECT || event.type == EVENT_OPEN) {
+                    if (!get(&event.archiveID, sizeof(event.archiveID)) || !getPath(event.archivePath) ||
+                        !getPath(event.filePath))
+                        return false;
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Runs on the worker, the client's requests are recorded in the meantime
+        // and followed once the profile is loaded
+        static void Load() {
+            Handle file;
+            Result res = FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, PROFILE_PATH), FS_OPEN_READ, 0);
+            if (R_FAILED(res))
+                return;
+
+            u64 size = 0;
+            std::vector<u8> data;
+            u32 bytes_read = 0;
+            res = FSFILE_GetSize(file, &size);
+            if (R_SUCCEEDED(res) && size <= MAX_PROFILE_SIZE) {
+                data.resize((size_t)size);
+                res = FSFILE_Read(file, &bytes_read, 0, data.data(), (u32)size);
+            }
+            FSFILE_Close(file);
+
+            std::vector<Event> loadedProfile;
+            if (R_FAILED(res) || data.empty() || bytes_read != size || !Parse(data, loadedProfile)) {
+                logger.Debug("Prefetch: profile discarded");
+                return;
+            }
+
+            CTRPluginFramework::Lock l(profileMutex);
+            profile = std::move(loadedProfile);
+            replaying = !profile.empty();
+            for (u32 i = 0; i < recorded.size() && replaying; i++)
+                Follow(i);
+        }
+
+        static void Save() {
+            std::vector<u8> data;
+            auto put = [&data](const void* in, size_t size) {
+                data.insert(data.end(), (const u8*)in, (const u8*)in + size);
+            };
+            auto putPath = [&put](const std::string& path) {
+                u16 size = (u16)path.size();
+                put(&size, sizeof(size));
+                put(path.data(), size);
+            };
+
+            ProfileHeader header = {PROFILE_MAGIC, PROFILE_VERSION, 0, osGetFirmVersion(), 0};
+            put(&header, sizeof(header));
+            for (const Event& event : recorded) {
+                size_t start = data.size();
+                put(&event.type, sizeof(event.type));
+                if (event.type == EVENT_READ) {
+                    put(&event.file, sizeof(event.file));
+                    put(&event.offset, sizeof(event.offset));
+                    put(&event.size, sizeof(event.size));
+                } else {
+                    put(&event.archiveID, sizeof(event.archiveID));
+                    putPath(event.archivePath);
+                    putPath(event.filePath);
+                }
+                // Reads only refer to earlier events, so the profile can be cut anywhere
+                if (data.size() > MAX_PROFILE_SIZE) {
+                    data.resize(start);
+                    break;
+                }
+                header.eventCount++;
+            }
+            memcpy(data.data(), &header, sizeof(header));
+
+            FS_Archive sdmc;
+            if (R_SUCCEEDED(FSUSER_OpenArchive(&sdmc, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+                FSUSER_CreateDirectory(sdmc, fsMakePath(PATH_ASCII, "/3ds"), 0);
+                FSUSER_CreateDirectory(sdmc, fsMakePath(PATH_ASCII, PROFILE_DIR), 0);
+                FSUSER_CloseArchive(sdmc);
+            }
+
+            Handle file;
+            OpenFileCache::InvalidatePath(fsMakePath(PATH_ASCII, PROFILE_PATH));
+            Result res = FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, PROFILE_PATH), FS_OPEN_WRITE | FS_OPEN_CREATE, 0);
+            if (R_SUCCEEDED(res)) {
+                u32 bytes_written;
+                res = FSFILE_SetSize(file, 0);
+                if (R_SUCCEEDED(res))
+                    res = FSFILE_Write(file, &bytes_written, 0, data.data(), (u32)data.size(), FS_WRITE_FLUSH);
+                FSFILE_Close(file);
+            }
+            if (R_FAILED(res))
+                logger.Debug("Prefetch: failed to save profile: 0x%08X", (u32)res);
+        }
+
+        // Builds the open file cache key of an open event, archive handles are
+        // looked up in the archives currently open by the client and pinned
+        static bool GetKey(const Event& open, std::string& key, u64& archive, bool pin) {
+            FS_Path filePath = ToPath(open.filePath);
+            if (open.type == EVENT_OPEN_DIRECT) {
+                FS_Path archivePath = ToPath(open.archivePath);
+                key = OpenFileCache::MakeKey(open.archiveID, &archivePath, filePath);
+                return true;
+            }
+            for (auto& [handle, info] : archives) {
+                if (!info.closing && info.archiveID == open.archiveID && info.path == open.archivePath) {
+                    archive = handle;
+                    key = OpenFileCache::MakeKey(handle, nullptr, filePath);
+                    if (pin)
+                        info.pins++;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static void Unpin(u64 archive) {
+            auto it = archives.find(archive);
+            if (it != archives.end() && it->second.pins && --it->second.pins == 0)
+                LightEvent_Signal(&unpinEvent);
+        }
+
+        static bool MakeJob(u32 index, Job& job) {
+            const Event& event = profile[index];
+            if (event.type == EVENT_READ) {
+                // Large reads have nowhere to be kept
+                if (event.size == 0 || event.size > ReadCoalescer::MAX_COALESCED_READ)
+                    return false;
+                u64 archive = 0;
+                if (!GetKey(profile[event.file], job.key, archive, false))
+                    return false;
+            } else if (!GetKey(event, job.key, job.archive, event.type == EVENT_OPEN)) {
+                return false;
+            }
+            job.event = event;
+            return true;
+        }
+
+        // Returns true if FS was accessed
+        static bool Prefetch(const Job& job) {
+            const Event& event = job.event;
+            Result res;
+            Handle file;
+
+            if (event.type == EVENT_READ) {
+                if (!OpenFileCache::Open(job.key, res, file, true) || R_FAILED(res))
+                    return false;
+
+                ScratchPool::Arena arena;
+                void* buffer = arena.Allocate(event.size);
+                u32 bytes_read;
+                s64 fsTicks;
+                if (buffer)
+                    ReadCoalescer::Read(file, event.offset, buffer, event.size, bytes_read, fsTicks);
+                OpenFileCache::Release(file);
+                return true;
+            }
+
+            if (OpenFileCache::Open(job.key, res, file, true)) {
+                if (R_SUCCEEDED(res))
+                    OpenFileCache::Release(file);
+                return false;
+            }
+
+            if (event.type == EVENT_OPEN_DIRECT)
+                res = FSUSER_OpenFileDirectly(&file, (FS_ArchiveID)event.archiveID, ToPath(event.archivePath), ToPath(event.filePath), FS_OPEN_READ, 0);
+            else
+                res = FSUSER_OpenFile(&file, (FS_Archive)job.archive, ToPath(event.filePath), FS_OPEN_READ, 0);
+
+            // Leave the file in the cache without any client reference
+            if (OpenFileCache::Insert(job.key, ToPath(event.filePath), res, file))
+                OpenFileCache::Release(file);
+            else if (R_SUCCEEDED(res))
+                FSFILE_Close(file);
+            return true;
+        }
+
+        static void WorkerMain(void*) {
+            Load();
+            while (true) {
+                LightEvent_Wait(&workerEvent);
+                while (true) {
+                    Job job;
+                    {
+                        CTRPluginFramework::Lock l(profileMutex);
+                        if (workerStop)
+                            return;
+                        if (queueCount == 0)
+                            break;
+
+                        u32 index = queue[queueStart];
+                        queueStart = (queueStart + 1) % QUEUE_SIZE;
+                        queueCount--;
+                        // Skip what the client already asked for
+                        if (!replaying || index < cursor || !MakeJob(index, job))
+                            continue;
+                    }
+
+                    bool fetched = Prefetch(job);
+
+                    CTRPluginFramework::Lock l(profileMutex);
+                    if (job.archive)
+                        Unpin(job.archive);
+                    if (fetched)
+                        prefetched++;
+                }
+            }
+        }
+
+        static void StartWorker() {
+            LightEvent_Init(&workerEvent, RESET_ONESHOT);
+            LightEvent_Init(&unpinEvent, RESET_STICKY);
+            s32 prio = 0x30;
+            svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+            // Lower priority than the server, so prefetching only uses idle time
+            worker = threadCreate(WorkerMain, nullptr, 0x2000, std::min(prio + 1, 0x3F), -2, false);
+        }
+
+        static void Schedule() {
+            scheduled = std::max(scheduled, cursor);
+            u32 added = 0;
+            while (scheduled < profile.size() && scheduled < cursor + LOOKAHEAD && queueCount < QUEUE_SIZE) {
+                queue[(queueStart + queueCount) % QUEUE_SIZE] = scheduled++;
+                queueCount++;
+                added++;
+            }
+            if (added)
+                LightEvent_Signal(&workerEvent);
+        }
+
+        // Moves the cursor past the profile event matching the one just recorded
+        static void Follow(u32 index) {
+            const Event& event = recorded[index];
+            u32 end = std::min<u32>(cursor + RESYNC_WINDOW, profile.size());
+            for (u32 i = cursor; i < end; i++) {
+                if (SameEvent(profile[i], event)) {
+                    cursor = i + 1;
+                    matched++;
+                    Schedule();
+                    return;
+                }
+            }
+
+            missed++;
+            if (missed >= RESYNC_WINDOW && missed > matched) {
+                logger.Debug("Prefetch: profile doesn't match, stopping");
+                replaying = false;
+            }
+        }
+
+        static void AddEvent(Handle file, Event&& event) {
+            if (!loaded) {
+                loaded = true;
+                StartWorker();
+            }
+            if (recorded.size() >= MAX_EVENTS)
+                return;
+
+            u16 index = (u16)recorded.size();
+            recorded.push_back(std::move(event));
+            if (recorded[index].type != EVENT_READ)
+                openFiles[file] = index;
+
+            if (replaying)
+                Follow(index);
+        }
+
+        void ArchiveOpened(u64 archive, u32 archiveID, const FS_Path& archivePath) {
+            CTRPluginFramework::Lock l(profileMutex);
+            archives[archive] = ArchiveInfo{archiveID, PathBytes(archivePath)};
+        }
+
+        void ArchiveClosed(u64 archive) {
+            while (true) {
+                {
+                    CTRPluginFramework::Lock l(profileMutex);
+                    auto it = archives.find(archive);
+                    if (it == archives.end())
+                        return;
+                    if (!it->second.pins) {
+                        archives.erase(it);
+                        return;
+                    }
+                    it->second.closing = true;
+                    LightEvent_Clear(&unpinEvent);
+                }
+                // A prefetch is opening a file from the archive, takes a single FS call
+                LightEvent_Wait(&unpinEvent);
+            }
+        }
+
+        void FileOpenedDirectly(Handle file, u32 archiveID, const FS_Path& archivePath, const FS_Path& filePath) {
+            Event event;
+            event.type = EVENT_OPEN_DIRECT;
+            event.archiveID = archiveID;
+            event.archivePath = PathBytes(archivePath);
+            event.filePath = PathBytes(filePath);
+
+            CTRPluginFramework::Lock l(profileMutex);
+            AddEvent(file, std::move(event));
+        }
+
+        void FileOpened(Handle file, u64 archive, const FS_Path& filePath) {
+            CTRPluginFramework::Lock l(profileMutex);
+            auto it = archives.find(archive);
+            if (it == archives.end())
+                return;
+
+            Event event;
+            event.type = EVENT_OPEN;
+            event.archiveID = it->second.archiveID;
+            event.archivePath = it->second.path;
+            event.filePath = PathBytes(filePath);
+            AddEvent(file, std::move(event));
+        }
+
+        void FileRead(Handle file, u64 offset, u32 size) {
+            CTRPluginFramework::Lock l(profileMutex);
+            auto it = openFiles.find(file);
+            if (it == openFiles.end())
+                return;
+
+            Event event;
+            event.type = EVENT_READ;
+            event.file = it->second;
+            event.offset = offset;
+            event.size = size;
+            AddEvent(file, std::move(event));
+        }
+
+        void MarkSuccess() {
+            CTRPluginFramework::Lock l(profileMutex);
+            success = true;
+        }
+
+        bool Finish() {
+            {
+                CTRPluginFramework::Lock l(profileMutex);
+                workerStop = true;
+                if (worker)
+                    LightEvent_Signal(&workerEvent);
+            }
+            if (worker) {
+                threadJoin(worker, U64_MAX);
+                threadFree(worker);
+                worker = nullptr;
+            }
+
+            CTRPluginFramework::Lock l(profileMutex);
+            if (matched || missed)
+                logger.Debug("Prefetch: matched=%u missed=%u prefetched=%u", matched, missed, prefetched);
+            if (success && !recorded.empty())
+                Save();
+
+            loaded = success = replaying = workerStop = false;
+            recorded.clear();
+            openFiles.clear();
+            archives.clear();
+            profile.clear();
+            cursor = scheduled = matched = missed = prefetched = 0;
+            queueStart = queueCount = 0;
+            return true;
+        }
+    }
+}
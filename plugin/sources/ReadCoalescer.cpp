@@ -0,0 +1,193 @@
+#include <string.h>
+#include <algorithm>
+
+#include "ReadCoalescer.hpp"
+#include "ScratchPool.hpp"
+#include "Bottleneck.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    namespace ReadCoalescer {
+
+        struct Block {
+            Handle file = 0;
+            u64 index = 0;
+            // Less than BLOCK_SIZE if the file ends in this block
+            u32 valid = 0;
+            u32 lastUse = 0;
+        };
+
+        static Block blocks[BLOCK_COUNT];
+        static u8 blockData[BLOCK_COUNT][BLOCK_SIZE];
+        static u32 useCounter = 0;
+        // Changes on every Forget, reads that saw another value don't keep their blocks
+        static u32 forgetCount = 0;
+        static Stats stats;
+        static CTRPluginFramework::Mutex coalescerMutex;
+
+        static Block* Find(Handle file, u64 index) {
+            for (Block& block : blocks) {
+                if (block.file == file && block.index == index) {
+                    block.lastUse = ++useCounter;
+                    return &block;
+                }
+            }
+            return nullptr;
+        }
+
+        static void Store(Handle file, u64 index, const u8* data, u32 valid) {
+            Block* slot = Find(file, index);
+            if (!slot) {
+                slot = &blocks[0];
+                for (Block& block : blocks) {
+                    if (!block.file) {
+                        slot = &block;
+                        break;
+                    }
+                    if (block.lastUse < slot->lastUse)
+                        slot = &block;
+                }
+            }
+            slot->file = file;
+            slot->index = index;
+            slot->valid = valid;
+            slot->lastUse = ++useCounter;
+            memcpy(blockData[slot - blocks], data, valid);
+        }
+
+        // Keeps the aligned blocks at both ends of a large read
+        static void KeepEdges(Handle file, u64 offset, const u8* data, u32 size, bool eof) {
+            u64 end = offset + size;
+            u64 firstFull = (offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            u64 endFull = end / BLOCK_SIZE;
+
+            if (firstFull < endFull) {
+                Store(file, firstFull, data + (firstFull * BLOCK_SIZE - offset), BLOCK_SIZE);
+                if (endFull - 1 != firstFull)
+                    Store(file, endFull - 1, data + ((endFull - 1) * BLOCK_SIZE - offset), BLOCK_SIZE);
+            }
+            if (eof && endFull * BLOCK_SIZE >= offset)
+                Store(file, endFull, data + (endFull * BLOCK_SIZE - offset), (u32)(end - endFull * BLOCK_SIZE));
+        }
+
+        static Result ReadFS(Handle file, u64 offset, void* out, u32 size, u32& bytesRead, s64& fsTicks) {
+            s64 start = svcGetSystemTick();
+            Result res = FS_TIMED(FSFILE_Read(file, &bytesRead, offset, out, size));
+            fsTicks += svcGetSystemTick() - start;
+            return res;
+        }
+
+        // Copies the part of the read covered by retained blocks, returns false if a block is missing
+        static bool CopyFromBlocks(Handle file, u64 offset, void* out, u32 size, u32& bytesRead) {
+            u64 end = offset + size;
+            u64 first = offset / BLOCK_SIZE, last = (end - 1) / BLOCK_SIZE;
+
+            bytesRead = 0;
+            for (u64 index = first; index <= last; index++) {
+                Block* block = Find(file, index);
+                if (!block)
+                    return false;
+
+                u64 blockStart = index * BLOCK_SIZE;
+                u32 from = (u32)(std::max(offset, blockStart) - blockStart);
+                u32 to = (u32)std::min<u64>(end - blockStart, BLOCK_SIZE);
+                if (block->valid <= from)
+                    break;
+
+                u32 copyEnd = std::min(to, block->valid);
+                memcpy((u8*)out + bytesRead, blockData[block - blocks] + from, copyEnd - from);
+                bytesRead += copyEnd - from;
+                if (copyEnd < to)
+                    break;
+            }
+            return true;
+        }
+
+        // FS is never accessed with coalescerMutex held, so reads from the prefetch
+        // worker and the server don't wait for each other's IPC
+        Result Read(Handle file, u64 offset, void* out, u32 size, u32& bytesRead, s64& fsTicks) {
+            fsTicks = 0;
+            u32 forgets;
+            bool large = size == 0 || size > MAX_COALESCED_READ;
+            {
+                CTRPluginFramework::Lock l(coalescerMutex);
+                stats.requests++;
+                forgets = forgetCount;
+                if (!large && CopyFromBlocks(file, offset, out, size, bytesRead)) {
+                    stats.blockHits++;
+                    stats.bytesFromBlocks += bytesRead;
+                    return 0;
+                }
+                stats.fsReads++;
+            }
+
+            if (large) {
+                Result res = ReadFS(file, offset, out, size, bytesRead, fsTicks);
+                CTRPluginFramework::Lock l(coalescerMutex);
+                // Blocks read by a handle that was closed meanwhile would outlive it
+                if (R_SUCCEEDED(res) && forgets == forgetCount)
+                    KeepEdges(file, offset, (const u8*)out, bytesRead, bytesRead < size);
+                return res;
+            }
+
+            // Read every block of the request with a single FS request, the ones
+            // already retained are cheaper to read again than to keep track of
+            u64 first = offset / BLOCK_SIZE, last = (offset + size - 1) / BLOCK_SIZE;
+            u32 count = (u32)(last - first + 1);
+            ScratchPool::Arena arena;
+            u8* buffer = (u8*)arena.Allocate(count * BLOCK_SIZE);
+            if (!buffer)
+                return ReadFS(file, offset, out, size, bytesRead, fsTicks);
+
+            u32 got = 0;
+            Result res = ReadFS(file, first * BLOCK_SIZE, buffer, count * BLOCK_SIZE, got, fsTicks);
+            if (R_FAILED(res))
+                return res;
+
+            u32 skip = (u32)(offset - first * BLOCK_SIZE);
+            bytesRead = got > skip ? std::min(got - skip, size) : 0;
+            memcpy(out, buffer + skip, bytesRead);
+
+            CTRPluginFramework::Lock l(coalescerMutex);
+            if (forgets != forgetCount)
+                return res;
+            for (u32 i = 0; i < count; i++) {
+                u32 valid = got > i * BLOCK_SIZE ? std::min(BLOCK_SIZE, got - i * BLOCK_SIZE) : 0;
+                Store(file, first + i, buffer + i * BLOCK_SIZE, valid);
+                if (valid < BLOCK_SIZE)
+                    break;
+            }
+            return res;
+        }
+
+        void Forget(Handle file) {
+            CTRPluginFramework::Lock l(coalescerMutex);
+            forgetCount++;
+            for (Block& block : blocks) {
+                if (block.file == file)
+                    block = Block();
+            }
+        }
+
+        Stats GetStats() {
+            CTRPluginFramework::Lock l(coalescerMutex);
+            return stats;
+        }
+
+        bool Clear() {
+            CTRPluginFramework::Lock l(coalescerMutex);
+            if (stats.requests) {
+                logger.Debug("Reads: req=%u fs=%u hit=%u hitBytes=0x%X", stats.requests, stats.fsReads, stats.blockHits,
+                    (u32)stats.bytesFromBlocks);
+            }
+            forgetCount++;
+            for (Block& block : blocks)
+                block = Block();
+            stats = Stats();
+            return true;
+        }
+    }
+}
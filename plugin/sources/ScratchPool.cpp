@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <malloc.h>
+#include <algorithm>
+
+#include "ScratchPool.hpp"
+#include "ArtifactCache.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    namespace ScratchPool {
+
+        // Placed before every block, keeps the returned pointer 8 byte aligned
+        struct BlockHeader {
+            u32 capacity;
+            u32 sizeClass;
+        };
+
+        static constexpr u32 CLASS_COUNT = __builtin_ctz(MAX_CLASS_SIZE / MIN_CLASS_SIZE) + 1;
+        static constexpr u32 NO_CLASS = CLASS_COUNT;
+
+        static std::vector<BlockHeader*> freeBlocks[CLASS_COUNT];
+        static size_t inUse = 0;
+        static size_t highWater = 0;
+        static size_t retained = 0;
+        static u32 poolHits = 0;
+        static u32 poolMisses = 0;
+        static u32 largeFailures = 0;
+        static size_t lastFailedSize = 0;
+        static CTRPluginFramework::Mutex poolMutex;
+
+        static u32 GetSizeClass(size_t size) {
+            if (size > MAX_CLASS_SIZE)
+                return NO_CLASS;
+            u32 sizeClass = 0;
+            while ((MIN_CLASS_SIZE << sizeClass) < size)
+                sizeClass++;
+            return sizeClass;
+        }
+
+        static void TrimLocked() {
+            for (auto& list : freeBlocks) {
+                for (BlockHeader* block : list)
+                    free(block);
+                list.clear();
+            }
+            retained = 0;
+        }
+
+        // Tries the allocation that's about to be done, never used to measure the heap
+        static bool TryAllocate(size_t size) {
+            void* probe = malloc(size);
+            free(probe);
+            return probe != nullptr;
+        }
+
+        void* Allocate(size_t size) {
+            u32 sizeClass = GetSizeClass(size);
+            size_t capacity = sizeClass == NO_CLASS ? size : (MIN_CLASS_SIZE << sizeClass);
+
+            CTRPluginFramework::Lock l(poolMutex);
+            BlockHeader* block = nullptr;
+            if (sizeClass != NO_CLASS && !freeBlocks[sizeClass].empty()) {
+                block = freeBlocks[sizeClass].back();
+                freeBlocks[sizeClass].pop_back();
+                retained -= capacity;
+                poolHits++;
+            } else {
+                poolMisses++;
+                block = (BlockHeader*)malloc(sizeof(BlockHeader) + capacity);
+                if (!block && retained) {
+                    TrimLocked();
+                    block = (BlockHeader*)malloc(sizeof(BlockHeader) + capacity);
+                }
+                while (!block && ArtifactCache::Evict(1) != 0) {
+                    block = (BlockHeader*)malloc(sizeof(BlockHeader) + capacity);
+                }
+                if (!block)
+                    return nullptr;
+                block->capacity = (u32)capacity;
+                block->sizeClass = sizeClass;
+            }
+
+            inUse += capacity;
+            if (inUse > highWater)
+                highWater = inUse;
+            return block + 1;
+        }
+
+        void Free(void* ptr) {
+            if (!ptr)
+                return;
+
+            BlockHeader* block = reinterpret_cast<BlockHeader*>(ptr) - 1;
+            CTRPluginFramework::Lock l(poolMutex);
+            inUse -= block->capacity;
+            if (block->sizeClass != NO_CLASS && retained + block->capacity <= MAX_RETAINED) {
+                freeBlocks[block->sizeClass].push_back(block);
+                retained += block->capacity;
+            } else {
+                free(block);
+            }
+        }
+
+        bool EnsureAvailable(size_t size) {
+            if (TryAllocate(size))
+                return true;
+
+            {
+                CTRPluginFramework::Lock l(poolMutex);
+                TrimLocked();
+            }
+            if (TryAllocate(size))
+                return true;
+
+            while (ArtifactCache::Evict(1) != 0) {
+                if (TryAllocate(size))
+                    return true;
+            }
+
+            CTRPluginFramework::Lock l(poolMutex);
+            largeFailures++;
+            lastFailedSize = size;
+            return false;
+        }
+
+        bool Trim() {
+            CTRPluginFramework::Lock l(poolMutex);
+            TrimLocked();
+            return true;
+        }
+
+        Stats GetStats() {
+            struct mallinfo info = mallinfo();
+            Stats stats;
+            stats.heapUsed = info.uordblks;
+            stats.heapFree = info.fordblks;
+            stats.heapTopFree = std::min<size_t>(info.keepcost, info.fordblks);
+            stats.heapFreeChunks = info.ordblks;
+            if (stats.heapFree == 0)
+                stats.fragmentationPercent = 0;
+            else
+                stats.fragmentationPercent = (u32)((u64)(stats.heapFree - stats.heapTopFree) * 100 / stats.heapFree);
+
+            CTRPluginFramework::Lock l(poolMutex);
+            stats.inUse = inUse;
+            stats.highWater = highWater;
+            stats.retained = retained;
+            stats.poolHits = poolHits;
+            stats.poolMisses = poolMisses;
+            stats.largeFailures = largeFailures;
+            stats.lastFailedSize = lastFailedSize;
+            return stats;
+        }
+
+        void LogStats() {
+            Stats stats = GetStats();
+            logger.Debug("Scratch: use=0x%X peak=0x%X kept=0x%X hit=%u miss=%u", (u32)stats.inUse, (u32)stats.highWater,
+                (u32)stats.retained, stats.poolHits, stats.poolMisses);
+            logger.Debug("Heap: used=0x%X free=0x%X top=0x%X chunks=%u frag=%u%% fail=%u", (u32)stats.heapUsed, (u32)stats.heapFree,
+                (u32)stats.heapTopFree, stats.heapFreeChunks, stats.fragmentationPercent, stats.largeFailures);
+        }
+
+        Arena::~Arena() {
+            for (void* block : blocks)
+                Free(block);
+        }
+
+        void* Arena::Allocate(size_t size) {
+            void* block = ScratchPool::Allocate(size);
+            if (block)
+                blocks.push_back(block);
+            return block;
+        }
+    }
+}
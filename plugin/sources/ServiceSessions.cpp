@@ -0,0 +1,103 @@
+#include "ServiceSessions.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+extern "C" {
+#include "csvc.h"
+}
+
+namespace ArticFunctions {
+
+    Result loaderInitCustom(void);
+    void loaderExitCustom(void);
+
+    CTRPluginFramework::Mutex amMutex;
+    CTRPluginFramework::Mutex cfgMutex;
+    CTRPluginFramework::Mutex loaderMutex;
+    CTRPluginFramework::Mutex pxiFSMutex;
+
+    Result ServiceSession::Acquire() {
+        CTRPluginFramework::Lock l(mutex);
+        if (!opened) {
+            Result res = openFunc();
+            if (R_FAILED(res))
+                return res;
+            opened = true;
+        }
+        // A new user keeps the session open, no need to reopen it later
+        closePending = false;
+        refCount++;
+        return 0;
+    }
+
+    void ServiceSession::Release() {
+        CTRPluginFramework::Lock l(mutex);
+        if (refCount && --refCount == 0 && closePending)
+            CloseLocked();
+    }
+
+    void ServiceSession::Close() {
+        CTRPluginFramework::Lock l(mutex);
+        if (refCount) {
+            logger.Debug("Deferring service session close, %d active users", refCount);
+            closePending = true;
+            return;
+        }
+        CloseLocked();
+    }
+
+    void ServiceSession::CloseLocked() {
+        closePending = false;
+        if (opened) {
+            closeFunc();
+            opened = false;
+        }
+    }
+
+    namespace ServiceSessions {
+
+        static Handle pxiFSHandle = 0;
+        static FSPXI_Archive pxiFSNandArchive = 0;
+
+        static Result pxiFSOpen(void) {
+            Result res = svcControlService(SERVICEOP_STEAL_CLIENT_SESSION, &pxiFSHandle, "PxiFS0");
+            if (R_FAILED(res))
+                return res;
+
+            res = FSPXI_OpenArchive(pxiFSHandle, &pxiFSNandArchive, ARCHIVE_NAND_CTR_FS, fsMakePath(PATH_EMPTY, ""));
+            if (R_FAILED(res)) {
+                svcCloseHandle(pxiFSHandle);
+                pxiFSHandle = 0;
+            }
+            return res;
+        }
+
+        static void pxiFSClose(void) {
+            FSPXI_CloseArchive(pxiFSHandle, pxiFSNandArchive);
+            svcCloseHandle(pxiFSHandle);
+            pxiFSHandle = 0;
+            pxiFSNandArchive = 0;
+        }
+
+        ServiceSession am(amMutex, amInit, amExit);
+        ServiceSession cfg(cfgMutex, cfguInit, cfguExit);
+        ServiceSession loader(loaderMutex, loaderInitCustom, loaderExitCustom);
+        ServiceSession pxiFS(pxiFSMutex, pxiFSOpen, pxiFSClose);
+
+        Handle GetPxiFSHandle() {
+            return pxiFSHandle;
+        }
+
+        FSPXI_Archive GetPxiFSNandArchive() {
+            return pxiFSNandArchive;
+        }
+
+        bool CloseAll() {
+            am.Close();
+            cfg.Close();
+            loader.Close();
+            pxiFS.Close();
+            return true;
+        }
+    }
+}
@@ -0,0 +1,173 @@
+#include <string.h>
+#include <algorithm>
+
+#include "SessionTrace.hpp"
+#include "OpenFileCache.hpp"
+#include "CTRPluginFramework/Time.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+#include "Main.hpp"
+
+namespace ArticFunctions {
+
+    namespace SessionTrace {
+
+        using CTRPluginFramework::Time;
+
+        static constexpr const char* TRACE_DIR = "/3ds/AzaharArticSetup";
+        // Records are handed to the writer in batches of at least this size while a session runs
+        static constexpr size_t FLUSH_SIZE = 0x8000;
+        // Records are dropped instead of queued past this, if the writer falls behind
+        static constexpr size_t MAX_PENDING = 0x40000;
+
+        static bool enabled = false;
+        static bool sessionStarted = false;
+        static s64 lastStart = 0;
+        static u32 written = 0;
+        static u32 dropped = 0;
+        static std::string pending;
+        static CTRPluginFramework::Mutex traceMutex;
+
+        static Thread writer = nullptr;
+        static LightEvent writerEvent;
+        static bool writerStop = false;
+
+        static void Write(const std::string& data) {
+            Handle file;
+            OpenFileCache::InvalidatePath(fsMakePath(PATH_ASCII, TRACE_PATH));
+            Result res = FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, TRACE_PATH), FS_OPEN_WRITE | FS_OPEN_CREATE, 0);
+            if (R_SUCCEEDED(res)) {
+                u64 size = 0;
+                u32 bytes_written;
+                res = FSFILE_GetSize(file, &size);
+                if (R_SUCCEEDED(res) && size == 0) {
+                    FileHeader header = {TRACE_MAGIC, TRACE_VERSION, 0, osGetFirmVersion()};
+                    res = FSFILE_Write(file, &bytes_written, 0, &header, sizeof(header), 0);
+                    size = sizeof(header);
+                }
+                if (R_SUCCEEDED(res))
+                    res = FSFILE_Write(file, &bytes_written, size, data.data(), (u32)data.size(), FS_WRITE_FLUSH);
+                FSFILE_Close(file);
+            }
+            if (R_FAILED(res)) {
+                logger.Warning("Trace: failed to write: 0x%08X", (u32)res);
+            } else {
+                written += data.size();
+            }
+        }
+
+        // Writes what is pending without holding traceMutex, so requests are never
+        // kept waiting by the SD card
+        static void WriterMain(void*) {
+            std::string batch;
+            while (true) {
+                LightEvent_Wait(&writerEvent);
+                while (true) {
+                    bool stop;
+                    {
+                        CTRPluginFramework::Lock l(traceMutex);
+                        stop = writerStop;
+                        batch.swap(pending);
+                    }
+                    if (batch.empty()) {
+                        if (stop)
+                            return;
+                        break;
+                    }
+                    Write(batch);
+                    batch.clear();
+                }
+            }
+        }
+
+        static void StartWriter() {
+            LightEvent_Init(&writerEvent, RESET_ONESHOT);
+            s32 prio = 0x30;
+            svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+            // Lower priority than the server, so writing only uses idle time
+            writer = threadCreate(WriterMain, nullptr, 0x2000, std::min(prio + 1, 0x3F), -2, false);
+        }
+
+        bool Setup() {
+            Handle file;
+            if (R_FAILED(FSUSER_OpenFileDirectly(&file, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, ""), fsMakePath(PATH_ASCII, TRACE_ENABLE_PATH), FS_OPEN_READ, 0)))
+                return true;
+            FSFILE_Close(file);
+
+            FS_Archive sdmc;
+            if (R_SUCCEEDED(FSUSER_OpenArchive(&sdmc, ARCHIVE_SDMC, fsMakePath(PATH_EMPTY, "")))) {
+                FSUSER_CreateDirectory(sdmc, fsMakePath(PATH_ASCII, "/3ds"), 0);
+                FSUSER_CreateDirectory(sdmc, fsMakePath(PATH_ASCII, TRACE_DIR), 0);
+                FSUSER_CloseArchive(sdmc);
+            }
+            enabled = true;
+            logger.Info("Trace: recording requests to %s", TRACE_PATH);
+            return true;
+        }
+
+        bool IsEnabled() {
+            return enabled;
+        }
+
+        void Append(s64 startTicks, RequestRecord& header, const std::string& body) {
+            CTRPluginFramework::Lock l(traceMutex);
+            if (!sessionStarted) {
+                if (!writer)
+                    StartWriter();
+                pending += (char)RECORD_SESSION;
+                sessionStarted = true;
+                lastStart = startTicks;
+            }
+
+            // Requests on other threads may have started earlier
+            s64 gap = std::max<s64>(startTicks - lastStart, 0);
+            header.gapUs = (u32)std::min<s64>(gap * 1000000 / Time::TicksPerSecond, UINT32_MAX);
+            lastStart = std::max(lastStart, startTicks);
+
+            if (pending.size() + sizeof(header) + body.size() > MAX_PENDING) {
+                dropped++;
+                return;
+            }
+            pending.append((const char*)&header, sizeof(header));
+            pending += body;
+            if (writer && pending.size() >= FLUSH_SIZE)
+                LightEvent_Signal(&writerEvent);
+        }
+
+        bool End() {
+            if (!enabled)
+                return true;
+
+            // The writer empties the queue before stopping
+            {
+                CTRPluginFramework::Lock l(traceMutex);
+                writerStop = true;
+                if (writer)
+                    LightEvent_Signal(&writerEvent);
+            }
+            if (writer) {
+                threadJoin(writer, U64_MAX);
+                threadFree(writer);
+                writer = nullptr;
+            }
+
+            // Left over if the writer couldn't be started
+            std::string rest;
+            {
+                CTRPluginFramework::Lock l(traceMutex);
+                rest.swap(pending);
+            }
+            if (!rest.empty())
+                Write(rest);
+
+            CTRPluginFramework::Lock l(traceMutex);
+            if (sessionStarted)
+                logger.Debug("Trace: 0x%X bytes written", written);
+            if (dropped)
+                logger.Warning("Trace: %u requests dropped, SD card too slow", dropped);
+            sessionStarted = writerStop = false;
+            dropped = 0;
+            return true;
+        }
+    }
+}
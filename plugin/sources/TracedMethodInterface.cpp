@@ -0,0 +1,135 @@
+#include <string.h>
+#include <algorithm>
+
+#include "TracedMethodInterface.hpp"
+#include "Bottleneck.hpp"
+#include "TransferTuner.hpp"
+#include "ScratchPool.hpp"
+#include "Main.hpp"
+#include "CTRPluginFramework/Time.hpp"
+
+namespace ArticFunctions {
+
+    using CTRPluginFramework::Time;
+
+    // Result buffers from this size are made room for before being reserved
+    static constexpr size_t LARGE_RESULT_SIZE = 0x10000;
+
+    static u32 TicksToUs(s64 ticks) {
+        return (u32)std::min<s64>(ticks * 1000000 / Time::TicksPerSecond, UINT32_MAX);
+    }
+
+    TracedMethodInterface::TracedMethodInterface(ArticProtocolServer::MethodInterface& mi, const char* method, Metrics::MethodMetrics& metrics) : mi(mi), metrics(metrics) {
+        startTicks = svcGetSystemTick();
+        Bottleneck::RequestStarted(startTicks);
+        TransferTuner::RequestStarted(startTicks);
+        header.type = SessionTrace::RECORD_REQUEST;
+        header.status = SessionTrace::STATUS_NOT_FINISHED;
+        tracing = SessionTrace::IsEnabled();
+        if (!tracing)
+            return;
+        header.methodLength = (u8)strlen(method);
+        body.assign(method, header.methodLength);
+    }
+
+    TracedMethodInterface::~TracedMethodInterface() {
+        Bottleneck::RequestFinished();
+        header.durationUs = TicksToUs(svcGetSystemTick() - startTicks);
+        Metrics::RecordRequest(metrics, header.status, header.result, parameterBytes, header.resultBytes, header.durationUs);
+        if (tracing)
+            SessionTrace::Append(startTicks, header, body);
+    }
+
+    void TracedMethodInterface::AddParameter(u8 type, const void* data, size_t size) {
+        parameterBytes += size;
+        if (!tracing)
+            return;
+        body += (char)type;
+        if (type == SessionTrace::PARAMETER_BUFFER) {
+            u16 size16 = (u16)std::min<size_t>(size, UINT16_MAX);
+            body.append((const char*)&size16, sizeof(size16));
+            size = size16;
+        }
+        body.append((const char*)data, size);
+        header.parameterCount++;
+    }
+
+    bool TracedMethodInterface::GetParameterS8(s8& out) {
+        bool good = mi.GetParameterS8(out);
+        if (good) AddParameter(SessionTrace::PARAMETER_S8, &out, sizeof(out));
+        return good;
+    }
+
+    bool TracedMethodInterface::GetParameterS16(s16& out) {
+        bool good = mi.GetParameterS16(out);
+        if (good) AddParameter(SessionTrace::PARAMETER_S16, &out, sizeof(out));
+        return good;
+    }
+
+    bool TracedMethodInterface::GetParameterS32(s32& out) {
+        bool good = mi.GetParameterS32(out);
+        if (good) AddParameter(SessionTrace::PARAMETER_S32, &out, sizeof(out));
+        return good;
+    }
+
+    bool TracedMethodInterface::GetParameterS64(s64& out) {
+        bool good = mi.GetParameterS64(out);
+        if (good) AddParameter(SessionTrace::PARAMETER_S64, &out, sizeof(out));
+        return good;
+    }
+
+    bool TracedMethodInterface::GetParameterBuffer(void*& outBuff, size_t& outSize) {
+        bool good = mi.GetParameterBuffer(outBuff, outSize);
+        if (good) AddParameter(SessionTrace::PARAMETER_BUFFER, outBuff, outSize);
+        return good;
+    }
+
+    bool TracedMethodInterface::FinishInputParameters() {
+        return mi.FinishInputParameters();
+    }
+
+    ArticProtocolCommon::Buffer* TracedMethodInterface::ReserveResultBuffer(u32 bufferID, size_t bufferSize) {
+        // Big result buffers are the first allocations to fail once the heap is full or fragmented,
+        // release the retained scratch and cached artifacts they need so the request doesn't fail
+        if (bufferSize >= LARGE_RESULT_SIZE && !ScratchPool::EnsureAvailable(bufferSize)) {
+            logger.Error("Cannot allocate 0x%X bytes for result", (u32)bufferSize);
+        }
+        ArticProtocolCommon::Buffer* buffer = mi.ReserveResultBuffer(bufferID, bufferSize);
+        if (buffer) {
+            header.resultBuffers++;
+            header.resultBytes += buffer->bufferSize;
+        }
+        return buffer;
+    }
+
+    ArticProtocolCommon::Buffer* TracedMethodInterface::ResizeLastResultBuffer(ArticProtocolCommon::Buffer* buffer, size_t newSize) {
+        u32 oldSize = buffer->bufferSize;
+        buffer = mi.ResizeLastResultBuffer(buffer, newSize);
+        if (buffer)
+            header.resultBytes = header.resultBytes - oldSize + buffer->bufferSize;
+        return buffer;
+    }
+
+    void TracedMethodInterface::SetResultHandle(const void* handle, size_t size) {
+        if (size != 4 && size != 8)
+            return;
+        memcpy(resultHandle, handle, size);
+        header.handleSize = (u8)size;
+    }
+
+    void TracedMethodInterface::FinishGood(int returnValue) {
+        Bottleneck::ResultStarted();
+        TransferTuner::ResultStarted();
+        header.status = SessionTrace::STATUS_GOOD;
+        header.result = returnValue;
+        if (tracing && header.handleSize)
+            body.append((const char*)resultHandle, header.handleSize);
+        mi.FinishGood(returnValue);
+    }
+
+    void TracedMethodInterface::FinishInternalError() {
+        Bottleneck::ResultStarted();
+        header.status = SessionTrace::STATUS_INTERNAL_ERROR;
+        mi.FinishInternalError();
+    }
+}
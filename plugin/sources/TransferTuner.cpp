@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <stdint.h>
+
+#include "TransferTuner.hpp"
+#include "CTRPluginFramework/Time.hpp"
+#include "CTRPluginFramework/System/Mutex.hpp"
+#include "CTRPluginFramework/System/Lock.hpp"
+
+namespace ArticFunctions {
+
+    namespace TransferTuner {
+
+        using CTRPluginFramework::Time;
+
+        // Reads below SMALL_READ measure fixed costs, reads above LARGE_READ measure throughput
+        static constexpr u32 SMALL_READ = 0x1000;
+        static constexpr u32 LARGE_READ = 0x10000;
+        // Longer times until the next request mean the client was busy with something else
+        static constexpr s64 MAX_GAP = Time::TicksPerSecond;
+        // Chunks are sized so the fixed cost of a request is at most 1/(OVERHEAD_RATIO + 1) of it
+        static constexpr u64 OVERHEAD_RATIO = 7;
+
+        static s64 roundTrip = 0;
+        static s64 fsLatency = 0;
+        static s64 netRate = 0;
+        static s64 fsRate = 0;
+        // Read of the current request, waiting for its result to be sent
+        static bool readPending = false;
+        static u32 readBytes = 0;
+        // Result of the previous request being sent, if it was a read
+        static s64 sendStart = 0;
+        static u32 sendBytes = 0;
+        static CTRPluginFramework::Mutex tunerMutex;
+
+        static void Average(s64& value, s64 sample) {
+            value = value ? value + (sample - value) / 8 : sample;
+        }
+
+        static u32 TicksToUs(s64 ticks) {
+            return (u32)(ticks * 1000000 / Time::TicksPerSecond);
+        }
+
+        static u32 FloorPow2(u32 value) {
+            return value ? 1u << (31 - __builtin_clz(value)) : 0;
+        }
+
+        void RequestStarted(s64 ticks) {
+            CTRPluginFramework::Lock l(tunerMutex);
+            readPending = false;
+            if (!sendStart)
+                return;
+
+            // Since the result of the previous read was handed to the server: sending it and the client round trip
+            s64 gap = ticks - sendStart;
+            sendStart = 0;
+            if (gap <= 0 || gap > MAX_GAP)
+                return;
+
+            if (sendBytes < SMALL_READ) {
+                Average(roundTrip, gap);
+            } else if (sendBytes >= LARGE_READ) {
+                s64 transfer = gap;
+                if (roundTrip)
+                    transfer = std::max(gap - roundTrip, gap / 8);
+                Average(netRate, (s64)sendBytes * Time::TicksPerSecond / transfer);
+            }
+        }
+
+        void ResultStarted() {
+            s64 now = svcGetSystemTick();
+            CTRPluginFramework::Lock l(tunerMutex);
+            if (!readPending)
+                return;
+            readPending = false;
+            sendStart = now;
+            sendBytes = readBytes;
+        }
+
+        void ReadFinished(u32 bytes, s64 fsTicks) {
+            CTRPluginFramework::Lock l(tunerMutex);
+            // Reads served from retained blocks say nothing about FS
+            if (fsTicks > 0) {
+                if (bytes < SMALL_READ) {
+                    Average(fsLatency, fsTicks);
+                } else if (bytes >= LARGE_READ) {
+                    s64 transfer = std::max(fsTicks - fsLatency, fsTicks / 8);
+                    Average(fsRate, (s64)bytes * Time::TicksPerSecond / transfer);
+                }
+            }
+            readPending = true;
+            readBytes = bytes;
+        }
+
+        Hints GetHints(u32 maxChunkSize) {
+            CTRPluginFramework::Lock l(tunerMutex);
+            Hints hints;
+            hints.netBytesPerSecond = (u32)std::min<s64>(netRate, UINT32_MAX);
+            hints.fsBytesPerSecond = (u32)std::min<s64>(fsRate, UINT32_MAX);
+            hints.roundTripUs = TicksToUs(roundTrip);
+            hints.fsLatencyUs = TicksToUs(fsLatency);
+
+            maxChunkSize = std::max(FloorPow2(maxChunkSize), MIN_CHUNK_SIZE);
+            if (!netRate) {
+                // Nothing measured yet
+                hints.chunkSize = std::max(maxChunkSize / 4, MIN_CHUNK_SIZE);
+                return hints;
+            }
+
+            // The server reads and sends one request at a time, so both rates add up
+            u64 rate = netRate;
+            if (fsRate)
+                rate = (u64)netRate * fsRate / (netRate + fsRate);
+            u64 overhead = roundTrip + fsLatency;
+            u64 chunk = OVERHEAD_RATIO * overhead * rate / Time::TicksPerSecond;
+
+            hints.chunkSize = MIN_CHUNK_SIZE;
+            while (hints.chunkSize < chunk && hints.chunkSize < maxChunkSize)
+                hints.chunkSize <<= 1;
+            return hints;
+        }
+
+        bool Reset() {
+            CTRPluginFramework::Lock l(tunerMutex);
+            roundTrip = fsLatency = netRate = fsRate = sendStart = 0;
+            readPending = false;
+            readBytes = sendBytes = 0;
+            return true;
+        }
+    }
+}
@@ -19,11 +19,17 @@
 #include "plgldr.h"
 
 #include "BCLIM.hpp"
+#include "Metrics.hpp"
+#include "Bottleneck.hpp"
+#include "BootProfile.hpp"
 
 #include "logo.h"
 
 #define SOC_ALIGN       0x1000
 #define SOC_BUFFERSIZE  0x400000
+// Width of the bottom screen console. Traffic lines are padded to one column
+// less, a full line would wrap and the newline would skip a row.
+#define TRAFFIC_COLUMNS 40
 
 Logger logger;
 static bool should_run = true;
@@ -68,54 +74,108 @@ void    EnableSleep(void)
 	mcuHwcExit();
 }
 
+// Startup runs as three threads: the server thread brings up sockets and listens,
+// a setup thread runs the setup functions and Main() initializes the screens.
+// The server only accepts once both others are done, clients connecting earlier
+// wait in the listen backlog.
+static LightEvent bootEvent;
+static bool setupCorrect = false;
+
+// Doesn't log, the first call happens before the screens are initialized
+static int Listen(char* error, size_t errorSize) {
+    struct sockaddr_in servaddr = {0};
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        snprintf(error, errorSize, "Server: Cannot create socket");
+        return -1;
+    }
+
+    if (!ArticProtocolServer::SetNonBlock(fd, true)) {
+        snprintf(error, errorSize, "Server:: Failed to set non-block");
+        close(fd);
+        return -1;
+    }
+
+    servaddr.sin_family      = AF_INET;
+    servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    servaddr.sin_port        = htons(SERVER_PORT);
+    if (bind(fd, (struct sockaddr *) &servaddr, sizeof(servaddr)) < 0) {
+        snprintf(error, errorSize, "Server: Failed to bind() to port %d", SERVER_PORT);
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, 1) < 0) {
+        snprintf(error, errorSize, should_run ? "Server: Failed to listen()" : "");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void RunSetup(void* arg) {
+    BootProfile::Phase phase("setupFunctions");
+    bool correct = true;
+    for (auto it = ArticFunctions::setupFunctions.begin(); it != ArticFunctions::setupFunctions.end(); it++) {
+        correct = (*it)() && correct;
+    }
+    setupCorrect = correct;
+}
+
 void Start(void* arg) {
     int res;
-    void* SOC_buffer = memalign(SOC_ALIGN, SOC_BUFFERSIZE);
-    if ((res = socInit((u32*)SOC_buffer, SOC_BUFFERSIZE)) != 0) {
+    void* SOC_buffer;
+    {
+        BootProfile::Phase phase("socInit");
+        SOC_buffer = memalign(SOC_ALIGN, SOC_BUFFERSIZE);
+        res = socInit((u32*)SOC_buffer, SOC_BUFFERSIZE);
+    }
+    char listenError[0x40] = "";
+    if (res == 0) {
+        BootProfile::Phase phase("listen");
+        listen_fd = Listen(listenError, sizeof(listenError));
+    }
+
+    LightEvent_Wait(&bootEvent);
+    if (res != 0) {
         free(SOC_buffer);
         logger.Error("Server: Cannot initialize sockets");
         return;
     }
-    while (should_run) {
-        svcSleepThread(500000000);
-        struct sockaddr_in servaddr = {0};
-        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
-        if (listen_fd < 0) {
-            logger.Error("Server: Cannot create socket");
-            continue;
-        }
-
-        if (!ArticProtocolServer::SetNonBlock(listen_fd, true)) {
-            logger.Error("Server:: Failed to set non-block");
+    if (!setupCorrect) {
+        if (listen_fd >= 0) {
             close(listen_fd);
             listen_fd = -1;
-            continue;
         }
-
-        servaddr.sin_family      = AF_INET;
-        servaddr.sin_addr.s_addr = htonl(INADDR_ANY);
-        servaddr.sin_port        = htons(SERVER_PORT);
-        res = bind(listen_fd, (struct sockaddr *) &servaddr, sizeof(servaddr));
-        if (res < 0) {
-            logger.Error("Server: Failed to bind() to port %d", SERVER_PORT);
-            close(listen_fd);
-            listen_fd = -1;
-            continue;
+        socExit();
+        free(SOC_buffer);
+        return;
+    }
+    {
+        BootProfile::Phase phase("metrics");
+        if (ArticFunctions::Metrics::IsEnabled())
+            ArticFunctions::Metrics::StartServer(METRICS_PORT);
+    }
+    bool firstListen = true;
+    while (should_run) {
+        if (listen_fd < 0) {
+            if (listenError[0])
+                logger.Error("%s", listenError);
+            listenError[0] = '\0';
+            svcSleepThread(500000000);
+            listen_fd = Listen(listenError, sizeof(listenError));
+            if (listen_fd < 0)
+                continue;
         }
 
-        res = listen(listen_fd, 1);
-        if (res < 0) {
-            if (should_run) {
-                logger.Error("Server: Failed to listen()");
-            }
-            close(listen_fd);
-            listen_fd = -1;
-            continue;
-        }
-        
         struct in_addr host_id;
         host_id.s_addr = gethostid();
         logger.Info("Server: Listening on: %s:%d", inet_ntoa(host_id), SERVER_PORT);
+        if (firstListen) {
+            firstListen = false;
+            BootProfile::Mark("accepting");
+            BootProfile::Report("Boot");
+        }
 
         struct sockaddr_in peeraddr = {0};
         socklen_t peeraddr_len = sizeof(peeraddr);
@@ -163,6 +223,7 @@ void Start(void* arg) {
             (*it)();
         }
     }
+    ArticFunctions::Metrics::StopServer();
     socExit();
     free(SOC_buffer);
 }
@@ -170,32 +231,64 @@ void Start(void* arg) {
 PrintConsole topScreenConsole, bottomScreenConsole;
 
 void Main() {
-    logger.Start();
+    BootProfile::Start();
+    LightEvent_Init(&bootEvent, RESET_STICKY);
+
+    Thread serverThread = nullptr;
+    Thread setupThread = nullptr;
+    {
+        BootProfile::Phase phase("threadCreate");
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        // Runs every request handler, the boot report and the metrics server
+        serverThread = threadCreate(Start, nullptr, 0x4000, prio-1, -2, false);
+        setupThread = threadCreate(RunSetup, nullptr, 0x2000, prio, -2, false);
+    }
+
+    {
+        BootProfile::Phase phase("plgLdr");
+        plgLdrInit();
+        bool prevPluginState = ((PluginHeader*)0x07000000)->config[0] != 0;
+        PLGLDR__SetPluginLoaderState(prevPluginState);
+        PLGLDR__ClearPluginLoadParameters();
+        plgLdrExit();
+    }
 
-    plgLdrInit();
-    bool prevPluginState = ((PluginHeader*)0x07000000)->config[0] != 0;
-    PLGLDR__SetPluginLoaderState(prevPluginState);
-    PLGLDR__ClearPluginLoadParameters();
-    plgLdrExit();
+    {
+        BootProfile::Phase phase("gspLcdInit");
+        gspLcdInit();
+    }
 
-    gspLcdInit();
+    {
+        BootProfile::Phase phase("gfxInitDefault");
+        gfxInitDefault();
+    }
 
-    gfxInitDefault();
-	consoleInit(GFX_TOP, &topScreenConsole);
-    consoleInit(GFX_BOTTOM, &bottomScreenConsole);
-    topScreenConsole.bg = 15; topScreenConsole.fg = 0;
-    bottomScreenConsole.bg = 15; bottomScreenConsole.fg = 0;
+    {
+        BootProfile::Phase phase("console");
+        consoleInit(GFX_TOP, &topScreenConsole);
+        consoleInit(GFX_BOTTOM, &bottomScreenConsole);
+        topScreenConsole.bg = 15; topScreenConsole.fg = 0;
+        bottomScreenConsole.bg = 15; bottomScreenConsole.fg = 0;
 
-    gfxSetDoubleBuffering(GFX_BOTTOM, false);
+        gfxSetDoubleBuffering(GFX_BOTTOM, false);
 
-    aptSetHomeAllowed(false);
+        aptSetHomeAllowed(false);
 
-    consoleSelect(&bottomScreenConsole);
-    consoleClear();
-    consoleSelect(&topScreenConsole);
-    consoleClear();
+        consoleSelect(&bottomScreenConsole);
+        consoleClear();
+        consoleSelect(&topScreenConsole);
+        consoleClear();
+    }
+
+    // Messages from the other threads are queued until the consoles exist
+    {
+        BootProfile::Phase phase("logger");
+        logger.Start();
+    }
 
     {
+        BootProfile::Phase phase("logo");
         CTRPluginFramework::BCLIM((void*)__data_logo_bin, __data_logo_bin_size).Render(CTRPluginFramework::Rect<int>((320 - 128) / 2, (240 - 128) / 2, 128, 128));
     }
 
@@ -211,19 +304,16 @@ void Main() {
     print_bottom_info();
     logger.Raw(true, "");
 
-    bool setupCorrect = true;
-    for (auto it = ArticFunctions::setupFunctions.begin(); it != ArticFunctions::setupFunctions.end(); it++) {
-        setupCorrect = (*it)() && setupCorrect;
+    if (setupThread) {
+        threadJoin(setupThread, U64_MAX);
+        threadFree(setupThread);
+    } else {
+        RunSetup(nullptr);
     }
-
-    Thread serverThread = nullptr;
     if (!setupCorrect) {
         logger.Error("Server: Setup failed");
-    } else {
-        s32 prio = 0;
-	    svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
-        serverThread = threadCreate(Start, nullptr, 0x1000, prio-1, -2, false);
     }
+    LightEvent_Signal(&bootEvent);
 
     CTRPluginFramework::Clock clock;
     bool sleeping = false;
@@ -284,12 +374,29 @@ void Main() {
                 CTRPluginFramework::Time t = clock.GetElapsedTime();
                 float bytes = transferedBytes / t.AsSeconds();
                 transferedBytes = 0;
-                float value = (bytes >= 1000 * 1000) ? (bytes / 1000.f * 1000.f) : (bytes / 1000.f);
+                float value = (bytes >= 1000 * 1000) ? (bytes / (1000.f * 1000.f)) : (bytes / 1000.f);
                 const char* unit = (bytes >= 1000 * 1000) ? "MB/s" : "KB/s";
-                logger.Traffic("          Traffic: %.02f %s     \n", value, unit);
+                ArticFunctions::Bottleneck::Summary summary = ArticFunctions::Bottleneck::GetSummary();
+                u8 share = 0;
+                switch (summary.verdict)
+                {
+                case ArticFunctions::Bottleneck::VERDICT_FS: share = summary.fsPercent; break;
+                case ArticFunctions::Bottleneck::VERDICT_NETWORK: share = summary.networkPercent; break;
+                case ArticFunctions::Bottleneck::VERDICT_CPU: share = summary.cpuPercent; break;
+                default: break;
+                }
+                char line[TRAFFIC_COLUMNS];
+                if (summary.requests && share) {
+                    // The biggest share of the session time is the bottleneck, at most 35 columns
+                    snprintf(line, sizeof(line), "Traffic: %7.02f %s  %s %3u%%", value, unit,
+                        ArticFunctions::Bottleneck::VerdictName(summary.verdict), share);
+                } else {
+                    snprintf(line, sizeof(line), "     Traffic: %.02f %s", value, unit);
+                }
+                logger.Traffic("%-*s\n", TRAFFIC_COLUMNS - 1, line);
                 clock.Restart();
             } else {
-                logger.Traffic("                                  \n");
+                logger.Traffic("%-*s\n", TRAFFIC_COLUMNS - 1, "");
             }
         }
 